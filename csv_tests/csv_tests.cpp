@@ -1,10 +1,48 @@
 
+#include <csv/checkpoint.hpp>
 #include <csv/datasource/icu/DataSource.hpp>
 #include <csv/datasource/utf8/DataSource.hpp>
+#include <csv/files.hpp>
+#include <csv/index.hpp>
+#include <csv/parallel.hpp>
 #include <csv/parser.hpp>
+#include <csv/push_parser.hpp>
+#include <csv/reader.hpp>
+#include <csv/records.hpp>
+#include <csv/sample.hpp>
+#include <csv/structural.hpp>
+#include <atomic>
 #include <filesystem>
+#include <fstream>
 #include <gtest/gtest.h>
+#include <mutex>
+#include <random>
+#include <set>
+#include <ranges>
 #include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <unistd.h>
+
+// Count heap allocations, so that tests can check that parsing doesn't allocate
+static std::atomic<size_t> allocations{0};
+
+void *operator new(size_t size) {
+  allocations++;
+  if (void *memory = malloc(size > 0 ? size : 1)) {
+    return memory;
+  }
+  throw std::bad_alloc();
+}
+
+// Not inlined, otherwise GCC warns about free() being called on memory from
+// operator new
+__attribute__((noinline)) void operator delete(void *memory) noexcept {
+  free(memory);
+}
+__attribute__((noinline)) void operator delete(void *memory, size_t) noexcept {
+  free(memory);
+}
 
 std::vector<csv::record> AddRecords(csv::IDataSource &data) {
   std::vector<csv::record> records;
@@ -46,6 +84,20 @@ std::vector<csv::record> AddRecords(const std::string &str) {
   return records;
 }
 
+void checkSameRecords(const std::vector<csv::record> &expected,
+                      const std::vector<csv::record> &records) {
+  ASSERT_EQ(expected.size(), records.size());
+  for (size_t i = 0; i < records.size(); ++i) {
+    ASSERT_EQ(expected[i].row, records[i].row);
+    ASSERT_EQ(expected[i].size(), records[i].size()) << "row " << i;
+    for (size_t j = 0; j < records[i].size(); ++j) {
+      ASSERT_EQ(expected[i][j].content, records[i][j].content)
+          << "row " << i << ", column " << j;
+      ASSERT_EQ(expected[i][j].column, records[i][j].column);
+    }
+  }
+}
+
 std::string getResource(const char *name) {
 #define STRINGIFY(a) STRINGIFY_HELPER_(a)
 #define STRINGIFY_HELPER_(a) #a
@@ -663,3 +715,2058 @@ TEST(CSVTests, Exception) {
   ASSERT_TRUE(caught) << "Didn't catch file exception";
 #endif
 }
+
+TEST(CSVTests, MappedFile) {
+  // The mapped source must produce exactly what the stream source produces
+  for (const char *name : {"orig.csv", "classification.csv",
+                           "simple_csv_utf8_bom.tsv", "small_sample.tsv",
+                           "small_sample_equal_not_equal_bom.tsv"}) {
+    const auto url = getResource(name);
+    ASSERT_FALSE(url.empty());
+
+    csv::utf8::FileDataSource file;
+    csv::utf8::MappedFileDataSource mapped;
+    if (url.find(".tsv") != std::string::npos) {
+      file.separator = '\t';
+      mapped.separator = '\t';
+    }
+
+    ASSERT_TRUE(file.open(url));
+    ASSERT_TRUE(mapped.open(url));
+
+    std::vector<csv::record> expected = AddRecords(file);
+    std::vector<csv::record> records = AddRecords(mapped);
+
+    SCOPED_TRACE(name);
+    checkSameRecords(expected, records);
+    checkRowIndexes(records);
+    ASSERT_EQ(1.0, mapped.progress());
+  }
+
+  ASSERT_THROW(csv::utf8::MappedFileDataSource("caterpillar"),
+               csv::file_exception);
+}
+
+TEST(CSVTests, FileBlockBoundaries) {
+  // Tiny blocks force every kind of lookahead/lookback (CRLF, doubled quotes,
+  // BOM) to happen across a block boundary
+  for (const char *name : {"orig.csv", "classification.csv", "ford_escort.csv",
+                           "simple_csv_utf8_bom.tsv", "title.basics.tsv"}) {
+    const auto url = getResource(name);
+    ASSERT_FALSE(url.empty());
+
+    csv::utf8::MappedFileDataSource mapped;
+    const char separator =
+        (url.find(".tsv") != std::string::npos) ? '\t' : ',';
+    mapped.separator = separator;
+    ASSERT_TRUE(mapped.open(url));
+    std::vector<csv::record> expected = AddRecords(mapped);
+
+    for (size_t bufferSize : {1, 2, 3, 4, 7, 64}) {
+      SCOPED_TRACE(std::string(name) + " / " + std::to_string(bufferSize));
+
+      csv::utf8::FileDataSource input;
+      input.separator = separator;
+      input.bufferSize = bufferSize;
+      ASSERT_TRUE(input.open(url));
+      checkSameRecords(expected, AddRecords(input));
+      ASSERT_EQ(1.0, input.progress());
+    }
+  }
+}
+
+TEST(CSVTests, TemplatedParse) {
+  // Parsing through the concrete source type must match parsing through the
+  // IDataSource interface
+  const auto url = getResource("classification.csv");
+  ASSERT_FALSE(url.empty());
+
+  csv::utf8::FileDataSource virtualInput;
+  ASSERT_TRUE(virtualInput.open(url));
+  std::vector<csv::record> expected = AddRecords(virtualInput);
+
+  csv::utf8::FileDataSource input;
+  ASSERT_TRUE(input.open(url));
+  std::vector<csv::record> records;
+  csv::State state = csv::parse(
+      input, NULL,
+      [&records](const csv::record &record,
+                 [[maybe_unused]] double complete) -> bool {
+        records.push_back(record);
+        return true;
+      });
+
+  ASSERT_EQ(csv::State::Complete, state);
+  checkSameRecords(expected, records);
+}
+
+struct ParseResult {
+  std::vector<csv::record> records;
+  std::vector<csv::field> fields;
+};
+
+template <typename Parse> ParseResult Collect(Parse parse) {
+  ParseResult result;
+  parse(
+      [&result](const csv::field &field) -> bool {
+        result.fields.push_back(field);
+        return true;
+      },
+      [&result](const csv::record &record,
+                [[maybe_unused]] double complete) -> bool {
+        result.records.push_back(record);
+        return true;
+      });
+  return result;
+}
+
+void checkSameResult(const ParseResult &expected, const ParseResult &result) {
+  checkSameRecords(expected.records, result.records);
+  ASSERT_EQ(expected.fields.size(), result.fields.size());
+  for (size_t i = 0; i < result.fields.size(); ++i) {
+    ASSERT_EQ(expected.fields[i].row, result.fields[i].row);
+    ASSERT_EQ(expected.fields[i].column, result.fields[i].column);
+    ASSERT_EQ(expected.fields[i].content, result.fields[i].content);
+  }
+}
+
+std::string RandomCSV(std::mt19937 &random, size_t length) {
+  // Heavy on the characters that matter to the parser
+  static const char alphabet[] = "ab  ,,,\"\"\"\r\n\n#\t";
+  std::uniform_int_distribution<size_t> pick(0, sizeof(alphabet) - 2);
+  std::string text;
+  for (size_t i = 0; i < length; ++i) {
+    text += alphabet[pick(random)];
+  }
+  return text;
+}
+
+void configure(csv::utf8::DataSource &source, unsigned int variant) {
+  source.separator = (variant & 1) ? '\t' : ',';
+  source.comment = (variant & 2) ? '#' : '\0';
+  source.trimLeadingWhitespace = (variant & 4) != 0;
+  source.skipBlankLines = (variant & 8) != 0;
+}
+
+TEST(CSVTests, StructuralClassify) {
+  std::mt19937 random(1234);
+  std::string text = RandomCSV(random, 64);
+  const csv::structural::block masks =
+      csv::structural::classify(text.data(), ',');
+  for (size_t i = 0; i < 64; ++i) {
+    ASSERT_EQ(text[i] == '"', ((masks.quote >> i) & 1) != 0);
+    ASSERT_EQ(text[i] == ',', ((masks.separator >> i) & 1) != 0);
+    ASSERT_EQ(text[i] == '\r' || text[i] == '\n',
+              ((masks.eol >> i) & 1) != 0);
+  }
+
+  ASSERT_EQ(0x0000000000000000ULL, csv::structural::prefix_xor(0));
+  ASSERT_EQ(0x000000000000000EULL, csv::structural::prefix_xor(0x12));
+  ASSERT_EQ(0xFFFFFFFFFFFFFFFFULL, csv::structural::prefix_xor(1));
+}
+
+TEST(CSVTests, StructuralMatchesParse) {
+  // The two-stage parser must give exactly the same results as csv::parse,
+  // including for badly formed input
+  std::mt19937 random(42);
+  std::uniform_int_distribution<size_t> lengths(0, 300);
+
+  for (unsigned int i = 0; i < 4000; ++i) {
+    const std::string text = RandomCSV(random, (i < 2000) ? i % 24 : lengths(random));
+    const unsigned int variant = i % 16;
+    SCOPED_TRACE(::testing::Message() << "variant " << variant << ": '" << text << "'");
+
+    csv::utf8::StringDataSource expectedInput(text);
+    configure(expectedInput, variant);
+    const ParseResult expected = Collect([&](auto field, auto record) {
+      csv::parse(expectedInput, field, record);
+    });
+
+    csv::utf8::StringDataSource input(text);
+    configure(input, variant);
+    const ParseResult result = Collect([&](auto field, auto record) {
+      csv::structural::parse(input, field, record);
+    });
+    ASSERT_NO_FATAL_FAILURE(checkSameResult(expected, result));
+  }
+}
+
+TEST(CSVTests, StructuralFiles) {
+  // Check real files, and records split across reads from the file
+  for (const char *name : {"orig.csv", "classification.csv", "ford_escort.csv",
+                           "simple_csv_utf8_bom.tsv", "title.basics.tsv",
+                           "korean.csv"}) {
+    const auto url = getResource(name);
+    ASSERT_FALSE(url.empty());
+    const char separator =
+        (url.find(".tsv") != std::string::npos) ? '\t' : ',';
+
+    csv::utf8::MappedFileDataSource expectedInput(url);
+    expectedInput.separator = separator;
+    const ParseResult expected = Collect([&](auto field, auto record) {
+      csv::parse(expectedInput, field, record);
+    });
+
+    for (size_t bufferSize : {3, 7, 64, 65, 1024 * 1024}) {
+      SCOPED_TRACE(std::string(name) + " / " + std::to_string(bufferSize));
+
+      csv::utf8::FileDataSource input;
+      input.separator = separator;
+      input.bufferSize = bufferSize;
+      ASSERT_TRUE(input.open(url));
+
+      double progress = 0;
+      ParseResult result;
+      csv::State state = csv::structural::parse(
+          input,
+          [&result](const csv::field &field) -> bool {
+            result.fields.push_back(field);
+            return true;
+          },
+          [&](const csv::record &record, double complete) -> bool {
+            EXPECT_LE(progress, complete);
+            progress = complete;
+            result.records.push_back(record);
+            return true;
+          });
+      ASSERT_EQ(csv::State::Complete, state);
+      ASSERT_NO_FATAL_FAILURE(checkSameResult(expected, result));
+      ASSERT_LT(0.99, progress);
+      ASSERT_GE(1.0, progress);
+    }
+  }
+}
+
+TEST(CSVTests, StructuralEarlyExit) {
+  csv::utf8::StringDataSource input("cat,dog\nfish,whale,pig\nsnork");
+
+  std::vector<csv::record> records;
+  csv::structural::parse(
+      input,
+      [](const csv::field &field) -> bool { return field.content != "whale"; },
+      [&records](const csv::record &record,
+                 [[maybe_unused]] double complete) -> bool {
+        records.push_back(record);
+        return true;
+      });
+
+  // The record containing the field that stopped parsing is still delivered
+  ASSERT_EQ(2, records.size());
+  ASSERT_EQ(2, records[1].size());
+  ASSERT_EQ("whale", records[1][1].content);
+}
+
+TEST(CSVTests, StructuralViews) {
+  // Records built from views must match csv::parse, blank lines included
+  std::mt19937 random(7);
+  for (unsigned int i = 0; i < 2000; ++i) {
+    const std::string text = RandomCSV(random, i % 200);
+    const unsigned int variant = i % 16;
+    SCOPED_TRACE(::testing::Message() << "variant " << variant << ": '" << text << "'");
+
+    csv::utf8::StringDataSource expectedInput(text);
+    configure(expectedInput, variant);
+    const ParseResult expected = Collect([&](auto field, auto record) {
+      csv::parse(expectedInput, field, record);
+    });
+
+    csv::utf8::StringDataSource input(text);
+    configure(input, variant);
+    std::vector<csv::record> records;
+    csv::structural::parse(
+        input, [&records](const csv::record_view &record,
+                          [[maybe_unused]] double complete) -> bool {
+          records.push_back(record.to_record());
+          return true;
+        });
+    ASSERT_NO_FATAL_FAILURE(checkSameRecords(expected.records, records));
+  }
+
+  // Across reads from a file
+  const auto url = getResource("classification.csv");
+  ASSERT_FALSE(url.empty());
+  csv::utf8::MappedFileDataSource expectedInput(url);
+  const ParseResult expected = Collect([&](auto field, auto record) {
+    csv::parse(expectedInput, field, record);
+  });
+
+  for (size_t bufferSize : {3, 7, 64, 65}) {
+    csv::utf8::FileDataSource input;
+    input.bufferSize = bufferSize;
+    ASSERT_TRUE(input.open(url));
+
+    std::vector<csv::record> records;
+    csv::structural::parse(
+        input, [&records](const csv::record_view &record,
+                          [[maybe_unused]] double complete) -> bool {
+          records.push_back(record.to_record());
+          return true;
+        });
+    ASSERT_NO_FATAL_FAILURE(checkSameRecords(expected.records, records));
+  }
+}
+
+TEST(CSVTests, StructuralViewsZeroCopy) {
+  const std::string text = "cat, \"dog\",\"fi\"\"sh\"\nwh\"ale,,pig\n";
+
+  csv::structural::tokenizer tokens;
+  tokens.feed(text.data(), text.size());
+  tokens.finish();
+
+  const auto inInput = [&text](const csv::field_view &field) {
+    return field.content.data() >= text.data() &&
+           field.content.data() + field.content.size() <= text.data() + text.size();
+  };
+
+  ASSERT_TRUE(tokens.next());
+  const csv::record_view &first = tokens.record();
+  ASSERT_EQ(3, first.size());
+  ASSERT_EQ("cat", first[0].content);
+  ASSERT_EQ("dog", first[1].content);
+  ASSERT_EQ("fi\"sh", first[2].content);
+  ASSERT_TRUE(inInput(first[0]));
+  ASSERT_TRUE(inInput(first[1]));
+
+  // A doubled quote has to be copied
+  ASSERT_FALSE(inInput(first[2]));
+
+  ASSERT_TRUE(tokens.next());
+  const csv::record_view &second = tokens.record();
+  ASSERT_EQ(1, second.row);
+  ASSERT_EQ(3, second.size());
+  ASSERT_EQ("wh\"ale", second[0].content);
+  ASSERT_TRUE(inInput(second[0]));
+  ASSERT_TRUE(second[1].content.empty());
+  ASSERT_EQ("pig", second[2].content);
+  ASSERT_EQ(2, second[2].column);
+
+  ASSERT_FALSE(tokens.next());
+}
+
+TEST(CSVTests, ArenaMatchesParse) {
+  std::mt19937 random(99);
+  for (unsigned int i = 0; i < 2000; ++i) {
+    const std::string text = RandomCSV(random, i % 200);
+    const unsigned int variant = i % 16;
+    SCOPED_TRACE(::testing::Message() << "variant " << variant << ": '" << text << "'");
+
+    csv::utf8::StringDataSource expectedInput(text);
+    configure(expectedInput, variant);
+    const std::vector<csv::record> expected = AddRecords(expectedInput);
+
+    csv::utf8::StringDataSource input(text);
+    configure(input, variant);
+    std::vector<csv::record> records;
+    csv::parse(input, [&records](const csv::record_view &record,
+                                 [[maybe_unused]] double complete) -> bool {
+      for (const csv::field_view &field : record) {
+        EXPECT_EQ(record.row, field.row);
+      }
+      records.push_back(record.to_record());
+      return true;
+    });
+    ASSERT_NO_FATAL_FAILURE(checkSameRecords(expected, records));
+  }
+}
+
+TEST(CSVTests, ArenaNoAllocations) {
+  // Once the first few records have been seen, parsing shouldn't allocate
+  std::string text;
+  for (size_t row = 0; row < 100000; ++row) {
+    text += "cat,\"dog, \"\"whale\"\"\",";
+    text += std::string(row % 17, 'x');
+    text += (row % 5 == 0) ? "\r\n\n" : "\n";
+  }
+
+  const auto steadyState = [](auto &input, auto parse) {
+    size_t warm = 0;
+    size_t count = 0;
+    const csv::State state = parse(
+        input, [&](const csv::record_view &record,
+                   [[maybe_unused]] double complete) -> bool {
+          if (++count == 100) {
+            warm = allocations;
+          }
+          return record.size() == 3;
+        });
+    EXPECT_EQ(csv::State::Complete, state);
+    EXPECT_EQ(100000, count);
+    return allocations - warm;
+  };
+
+  csv::utf8::StringDataSource input(text);
+  ASSERT_EQ(0, steadyState(input, [](auto &source, auto emit) {
+              return csv::parse(source, emit);
+            }));
+
+  input.set(text);
+  ASSERT_EQ(0, steadyState((csv::IDataSource &)input, [](auto &source, auto emit) {
+              return csv::parse(source, emit);
+            }));
+
+  input.set(text);
+  ASSERT_EQ(0, steadyState(input, [](auto &source, auto emit) {
+              return csv::structural::parse(source, emit);
+            }));
+}
+
+TEST(CSVTests, Batches) {
+  // Batches joined together must match csv::parse, whatever the limits
+  std::mt19937 random(2024);
+  for (unsigned int i = 0; i < 2000; ++i) {
+    const std::string text = RandomCSV(random, i % 200);
+    const unsigned int variant = i % 16;
+    csv::batch_limits limits;
+    limits.records = i % 4;
+    limits.bytes = (i / 4) % 3 * 4;
+    SCOPED_TRACE(::testing::Message() << "variant " << variant << ", limits "
+                                      << limits.records << "/" << limits.bytes
+                                      << ": '" << text << "'");
+
+    csv::utf8::StringDataSource expectedInput(text);
+    configure(expectedInput, variant);
+    const std::vector<csv::record> expected = AddRecords(expectedInput);
+
+    for (bool structural : {false, true}) {
+      csv::utf8::StringDataSource input(text);
+      configure(input, variant);
+
+      std::vector<csv::record> records;
+      auto addBatch = [&](const csv::record_batch &batch,
+                          [[maybe_unused]] double complete) -> bool {
+        EXPECT_FALSE(batch.empty());
+        if (limits.records > 0) {
+          EXPECT_GE(limits.records, batch.size());
+        }
+        for (const csv::record_view &record : batch) {
+          records.push_back(record.to_record());
+        }
+        return true;
+      };
+
+      if (structural) {
+        csv::structural::parse(input, limits, addBatch);
+      } else {
+        csv::parse(input, limits, addBatch);
+      }
+      ASSERT_NO_FATAL_FAILURE(checkSameRecords(expected, records));
+    }
+  }
+}
+
+TEST(CSVTests, BatchesEarlyExit) {
+  csv::utf8::StringDataSource input("a\nb\nc\nd\ne\nf\ng\n");
+  csv::batch_limits limits;
+  limits.records = 3;
+
+  size_t batches = 0;
+  std::vector<std::string> seen;
+  const csv::State state = csv::parse(
+      input, limits,
+      [&](const csv::record_batch &batch, double complete) -> bool {
+        batches++;
+        EXPECT_EQ(3, batch.size());
+        EXPECT_LT(0.0, complete);
+        for (const csv::record_view &record : batch) {
+          seen.push_back(std::string(record[0].content));
+        }
+        return batches < 2;
+      });
+
+  ASSERT_EQ(csv::State::Complete, state);
+  ASSERT_EQ(2, batches);
+  ASSERT_EQ((std::vector<std::string>{"a", "b", "c", "d", "e", "f"}), seen);
+}
+
+TEST(CSVTests, ReaderMatchesParse) {
+  std::mt19937 random(5);
+  for (unsigned int i = 0; i < 2000; ++i) {
+    const std::string text = RandomCSV(random, i % 200);
+    const unsigned int variant = i % 16;
+    SCOPED_TRACE(::testing::Message() << "variant " << variant << ": '" << text << "'");
+
+    csv::utf8::StringDataSource expectedInput(text);
+    configure(expectedInput, variant);
+    const std::vector<csv::record> expected = AddRecords(expectedInput);
+
+    csv::utf8::StringDataSource input(text);
+    configure(input, variant);
+    csv::reader records(input);
+    std::vector<csv::record> result;
+    for (const csv::record_view &record : records) {
+      result.push_back(record.to_record());
+    }
+    ASSERT_EQ(csv::State::Complete, records.state());
+    ASSERT_NO_FATAL_FAILURE(checkSameRecords(expected, result));
+  }
+}
+
+TEST(CSVTests, ReaderRanges) {
+  auto url = getResource("orig.csv");
+  ASSERT_FALSE(url.empty());
+  csv::utf8::FileDataSource input;
+  ASSERT_TRUE(input.open(url));
+
+  // Read through the generic data source interface
+  csv::reader<> records(input);
+  static_assert(std::ranges::input_range<decltype(records)>);
+
+  auto names = records |
+               std::views::filter([](const csv::record_view &record) {
+                 return record.row > 0 && record.size() > 3;
+               }) |
+               std::views::transform([](const csv::record_view &record) {
+                 return std::string(record[3].content);
+               }) |
+               std::views::take(3);
+
+  std::vector<std::string> result;
+  for (const std::string &name : names) {
+    result.push_back(name);
+  }
+  ASSERT_EQ(3, result.size());
+
+  // Carry on where the range stopped
+  csv::utf8::FileDataSource expectedInput;
+  ASSERT_TRUE(expectedInput.open(url));
+  const std::vector<csv::record> expected = AddRecords(expectedInput);
+  ASSERT_LT(4, expected.size());
+  for (size_t i = 0; i < 3; ++i) {
+    ASSERT_EQ(expected[i + 1][3].content, result[i]);
+  }
+
+  auto next = records.begin();
+  ASSERT_TRUE(next != records.end());
+  ASSERT_EQ(expected[4].row, next->row);
+  ASSERT_EQ(expected[4][0].content, (*next)[0].content);
+}
+
+TEST(CSVTests, CursorInterleaved) {
+  // Two sources parsed in turn on one thread
+  const auto first = getResource("classification.csv");
+  const auto second = getResource("orig.csv");
+  ASSERT_FALSE(first.empty());
+  ASSERT_FALSE(second.empty());
+
+  csv::utf8::MappedFileDataSource firstExpected(first);
+  csv::utf8::MappedFileDataSource secondExpected(second);
+  const std::vector<csv::record> expected[2] = {AddRecords(firstExpected),
+                                               AddRecords(secondExpected)};
+
+  csv::utf8::FileDataSource firstInput;
+  firstInput.bufferSize = 16;
+  ASSERT_TRUE(firstInput.open(first));
+  csv::utf8::FileDataSource secondInput;
+  secondInput.bufferSize = 5;
+  ASSERT_TRUE(secondInput.open(second));
+
+  csv::structural::cursor cursors[2] = {csv::structural::cursor(firstInput),
+                                        csv::structural::cursor(secondInput)};
+  std::vector<csv::record> records[2];
+  bool more[2] = {true, true};
+  while (more[0] || more[1]) {
+    for (size_t i = 0; i < 2; ++i) {
+      while (more[i]) {
+        more[i] = cursors[i].next();
+        if (more[i] && !cursors[i].record().empty()) {
+          records[i].push_back(cursors[i].record().to_record());
+          break;
+        }
+      }
+    }
+  }
+
+  ASSERT_EQ(csv::State::Complete, cursors[0].state());
+  ASSERT_EQ(csv::State::Complete, cursors[1].state());
+  ASSERT_NO_FATAL_FAILURE(checkSameRecords(expected[0], records[0]));
+  ASSERT_NO_FATAL_FAILURE(checkSameRecords(expected[1], records[1]));
+}
+
+TEST(CSVTests, RecordsGenerator) {
+  std::mt19937 random(11);
+  for (unsigned int i = 0; i < 2000; ++i) {
+    const std::string text = RandomCSV(random, i % 200);
+    const unsigned int variant = i % 16;
+    SCOPED_TRACE(::testing::Message() << "variant " << variant << ": '" << text << "'");
+
+    csv::utf8::StringDataSource expectedInput(text);
+    configure(expectedInput, variant);
+    const std::vector<csv::record> expected = AddRecords(expectedInput);
+
+    csv::utf8::StringDataSource input(text);
+    configure(input, variant);
+    std::vector<csv::record> records;
+    for (const csv::record_view &record : csv::records(input)) {
+      records.push_back(record.to_record());
+    }
+    ASSERT_NO_FATAL_FAILURE(checkSameRecords(expected, records));
+  }
+}
+
+std::string TemporaryFile(const std::string &name, const std::string &content) {
+  const std::string path =
+      (std::filesystem::temp_directory_path() / name).string();
+  std::ofstream out(path, std::ios::binary);
+  out << content;
+  return path;
+}
+
+// Removes files when it goes out of scope, so that they aren't left behind
+// when an assertion fails
+struct RemoveFiles {
+  std::vector<std::string> paths;
+  ~RemoveFiles() {
+    for (const auto &path : paths) {
+      std::error_code error;
+      std::filesystem::remove(path, error);
+    }
+  }
+};
+
+std::vector<csv::record> ParallelRecords(const std::string &path,
+                                         size_t threads,
+                                         const csv::structural::dialect &options,
+                                         size_t chunkSize) {
+  std::vector<csv::record> records;
+  const csv::State state = csv::parse_parallel(
+      path, threads,
+      [&records](const csv::record_view &record, double complete) -> bool {
+        EXPECT_LT(0.0, complete);
+        EXPECT_GE(1.0, complete);
+        records.push_back(record.to_record());
+        return true;
+      },
+      options, chunkSize);
+  EXPECT_EQ(csv::State::Complete, state);
+  return records;
+}
+
+TEST(CSVTests, ParallelMatchesParse) {
+  // Small chunks, so that most guesses at where records start are wrong
+  std::mt19937 random(77);
+  for (unsigned int i = 0; i < 500; ++i) {
+    const std::string text = RandomCSV(random, 1 + (i % 400));
+    const unsigned int variant = i % 16;
+    const size_t chunkSize = 1 + (i % 37);
+    const size_t threads = 1 + (i % 4);
+    SCOPED_TRACE(::testing::Message() << "variant " << variant << ", chunk "
+                                      << chunkSize << ": '" << text << "'");
+
+    csv::utf8::StringDataSource expectedInput(text);
+    configure(expectedInput, variant);
+    const std::vector<csv::record> expected = AddRecords(expectedInput);
+
+    csv::structural::dialect options;
+    options.separator = expectedInput.separator;
+    options.comment = expectedInput.comment;
+    options.trimLeadingWhitespace = expectedInput.trimLeadingWhitespace;
+    options.skipBlankLines = expectedInput.skipBlankLines;
+
+    const std::string path = TemporaryFile("csvlib_parallel.csv", text);
+    const RemoveFiles cleanup{{path}};
+    ASSERT_NO_FATAL_FAILURE(checkSameRecords(
+        expected, ParallelRecords(path, threads, options, chunkSize)));
+  }
+}
+
+TEST(CSVTests, ParallelFiles) {
+  for (const char *name : {"orig.csv", "classification.csv",
+                           "simple_csv_utf8_bom.tsv", "title.basics.tsv"}) {
+    const auto url = getResource(name);
+    ASSERT_FALSE(url.empty());
+
+    csv::structural::dialect options;
+    options.separator = (url.find(".tsv") != std::string::npos) ? '\t' : ',';
+
+    csv::utf8::MappedFileDataSource expectedInput(url);
+    expectedInput.separator = options.separator;
+    const std::vector<csv::record> expected = AddRecords(expectedInput);
+
+    for (size_t chunkSize : {16, 1000, 0}) {
+      SCOPED_TRACE(std::string(name) + " / " + std::to_string(chunkSize));
+      ASSERT_NO_FATAL_FAILURE(checkSameRecords(
+          expected, ParallelRecords(url, 4, options, chunkSize)));
+    }
+  }
+}
+
+TEST(CSVTests, ParallelEarlyExit) {
+  std::string text;
+  for (size_t i = 0; i < 10000; ++i) {
+    text += std::to_string(i) + ",\"a\nb\"\n";
+  }
+  const std::string path = TemporaryFile("csvlib_parallel_exit.csv", text);
+  const RemoveFiles cleanup{{path}};
+
+  size_t count = 0;
+  const csv::State state = csv::parse_parallel(
+      path, 4,
+      [&count](const csv::record_view &record,
+               [[maybe_unused]] double complete) -> bool {
+        EXPECT_EQ(count, record.row);
+        EXPECT_EQ(std::to_string(count), record[0].content);
+        EXPECT_EQ("a\nb", record[1].content);
+        return ++count < 5000;
+      },
+      csv::structural::dialect(), 100);
+  ASSERT_EQ(csv::State::Complete, state);
+  ASSERT_EQ(5000, count);
+
+  ASSERT_EQ(csv::State::Error,
+            csv::parse_parallel("/tmp/blah.12345", 4, nullptr));
+}
+
+csv::structural::dialect DialectFor(const csv::utf8::DataSource &source) {
+  csv::structural::dialect options;
+  options.separator = source.separator;
+  options.comment = source.comment;
+  options.trimLeadingWhitespace = source.trimLeadingWhitespace;
+  options.skipBlankLines = source.skipBlankLines;
+  return options;
+}
+
+TEST(CSVTests, PushParserMatchesParse) {
+  // Feed random pieces, down to a byte at a time
+  std::mt19937 random(31);
+  for (unsigned int i = 0; i < 3000; ++i) {
+    std::string text = RandomCSV(random, i % 200);
+    if (i % 5 == 0) {
+      text = "\xEF\xBB\xBF" + text;
+    } else if (i % 5 == 1) {
+      text = std::string("\xEF\xBB").substr(0, i % 3) + text;
+    }
+    const unsigned int variant = i % 16;
+    SCOPED_TRACE(::testing::Message() << "variant " << variant << ": '" << text << "'");
+
+    csv::utf8::StringDataSource expectedInput(text);
+    configure(expectedInput, variant);
+    const std::vector<csv::record> expected = AddRecords(expectedInput);
+
+    std::vector<csv::record> records;
+    csv::push_parser parser(
+        [&records](const csv::record_view &record, double complete) -> bool {
+          EXPECT_GE(1.0, complete);
+          records.push_back(record.to_record());
+          return true;
+        },
+        DialectFor(expectedInput));
+    parser.expectedSize = text.size();
+
+    const size_t largest = 1 + (i % 8);
+    for (size_t offset = 0; offset < text.size();) {
+      // Each piece is a separate copy, so the parser mustn't hold on to it
+      const size_t length =
+          std::min(text.size() - offset, 1 + (size_t)(random() % largest));
+      const std::string piece = text.substr(offset, length);
+      ASSERT_TRUE(parser.feed(piece.data(), piece.size()));
+      offset += length;
+    }
+    ASSERT_TRUE(parser.finish());
+    ASSERT_EQ(text.size(), parser.size());
+    ASSERT_NO_FATAL_FAILURE(checkSameRecords(expected, records));
+  }
+}
+
+TEST(CSVTests, PushParserEmitsPromptly) {
+  std::vector<std::string> seen;
+  csv::push_parser parser(
+      [&seen](const csv::record_view &record,
+              [[maybe_unused]] double complete) -> bool {
+        seen.push_back(std::string(record[0].content));
+        return seen.size() < 3;
+      });
+
+  const std::string input = "\"a\r\nb\",c\r\nd\re\nf\ng\n";
+  ASSERT_TRUE(parser.feed(input.data(), 6));
+  ASSERT_TRUE(seen.empty());
+  // The record is complete at the CR
+  ASSERT_TRUE(parser.feed(input.data() + 6, 3));
+  ASSERT_EQ(1, seen.size());
+  ASSERT_EQ("a\r\nb", seen[0]);
+
+  // Stopped by the callback
+  ASSERT_FALSE(parser.feed(input.data() + 9, input.size() - 9));
+  ASSERT_EQ((std::vector<std::string>{"a\r\nb", "d", "e"}), seen);
+  ASSERT_FALSE(parser.finish());
+
+  parser.reset();
+  seen.clear();
+  ASSERT_TRUE(parser.feed("x,y", 3));
+  ASSERT_TRUE(parser.finish());
+  ASSERT_EQ((std::vector<std::string>{"x"}), seen);
+}
+
+TEST(CSVTests, FdDataSourcePipe) {
+  const auto url = getResource("orig.csv");
+  ASSERT_FALSE(url.empty());
+  std::ifstream file(url, std::ios::binary);
+  const std::string text((std::istreambuf_iterator<char>(file)),
+                         std::istreambuf_iterator<char>());
+
+  csv::utf8::StringDataSource expectedInput(text);
+  const std::vector<csv::record> expected = AddRecords(expectedInput);
+
+  // Written a few bytes at a time (after a BOM), so reads return short blocks
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  std::thread writer([&text, fds]() {
+    const std::string data = "\xEF\xBB\xBF" + text;
+    for (size_t offset = 0; offset < data.size(); offset += 7) {
+      const size_t length = std::min<size_t>(7, data.size() - offset);
+      if (write(fds[1], data.data() + offset, length) != (ssize_t)length) {
+        break;
+      }
+    }
+    close(fds[1]);
+  });
+
+  csv::utf8::FdDataSource input;
+  input.bufferSize = 16;
+  ASSERT_TRUE(input.open(fds[0], true));
+
+  std::vector<csv::record> records;
+  std::vector<double> progress;
+  csv::parse(input, NULL,
+             [&](const csv::record &record, double complete) -> bool {
+               records.push_back(record);
+               progress.push_back(complete);
+               return true;
+             });
+  writer.join();
+
+  ASSERT_NO_FATAL_FAILURE(checkSameRecords(expected, records));
+  // The size of a pipe isn't known, so there's no progress until the end
+  ASSERT_EQ(0.0, progress.front());
+  ASSERT_EQ(1.0, progress.back());
+  ASSERT_EQ(1.0, input.progress());
+  ASSERT_EQ(text.size() + 3, input.consumed());
+
+  // A regular file has a known size
+  csv::utf8::FdDataSource fileInput(url);
+  ASSERT_NO_FATAL_FAILURE(checkSameRecords(expected, AddRecords(fileInput)));
+  ASSERT_EQ(1.0, fileInput.progress());
+
+  ASSERT_THROW(csv::utf8::FdDataSource("/tmp/blah.12345"),
+               csv::file_exception);
+}
+
+TEST(CSVTests, UringFileDataSource) {
+  for (const char *name : {"orig.csv", "classification.csv",
+                           "simple_csv_utf8_bom.tsv", "korean.csv"}) {
+    const auto url = getResource(name);
+    ASSERT_FALSE(url.empty());
+    const char separator =
+        (url.find(".tsv") != std::string::npos) ? '\t' : ',';
+
+    csv::utf8::MappedFileDataSource expectedInput(url);
+    expectedInput.separator = separator;
+    const std::vector<csv::record> expected = AddRecords(expectedInput);
+
+    for (size_t bufferSize : {3, 7, 64, 1024 * 1024}) {
+      for (unsigned int queueDepth : {1, 3, 8}) {
+        SCOPED_TRACE(std::string(name) + " / " + std::to_string(bufferSize) +
+                     " / " + std::to_string(queueDepth));
+
+        // Uses io_uring where available, otherwise blocking reads
+        csv::utf8::UringFileDataSource input;
+        input.separator = separator;
+        input.bufferSize = bufferSize;
+        input.queueDepth = queueDepth;
+        ASSERT_TRUE(input.open(url));
+        ASSERT_NO_FATAL_FAILURE(checkSameRecords(expected, AddRecords(input)));
+        ASSERT_EQ(1.0, input.progress());
+      }
+    }
+  }
+
+  // Not a regular file, so always read using blocking reads
+  csv::utf8::UringFileDataSource input("/dev/null");
+  ASSERT_FALSE(input.asynchronous());
+  ASSERT_TRUE(AddRecords(input).empty());
+
+  ASSERT_THROW(csv::utf8::UringFileDataSource("/tmp/blah.12345"),
+               csv::file_exception);
+}
+
+TEST(CSVTests, PrefetchDataSources) {
+  for (const char *name : {"orig.csv", "simple_csv_utf8_bom.tsv"}) {
+    const auto url = getResource(name);
+    ASSERT_FALSE(url.empty());
+    const char separator =
+        (url.find(".tsv") != std::string::npos) ? '\t' : ',';
+
+    csv::utf8::MappedFileDataSource expectedInput(url);
+    expectedInput.separator = separator;
+    const std::vector<csv::record> expected = AddRecords(expectedInput);
+
+    csv::utf8::FileDataSource file;
+    csv::utf8::FdDataSource fd;
+    csv::utf8::UringFileDataSource uring;
+    for (csv::utf8::BufferedDataSource *input :
+         std::initializer_list<csv::utf8::BufferedDataSource *>{&file, &fd,
+                                                                &uring}) {
+      for (size_t bufferSize : {3, 7, 64, 1024 * 1024}) {
+        for (size_t prefetchBuffers : {1, 4}) {
+          SCOPED_TRACE(std::string(name) + " / " + std::to_string(bufferSize) +
+                       " / " + std::to_string(prefetchBuffers));
+
+          input->separator = separator;
+          input->bufferSize = bufferSize;
+          input->prefetch = true;
+          input->prefetchBuffers = prefetchBuffers;
+          if (input == &file) {
+            ASSERT_TRUE(file.open(url));
+          } else if (input == &fd) {
+            ASSERT_TRUE(fd.open(url));
+          } else {
+            ASSERT_TRUE(uring.open(url));
+          }
+
+          std::vector<csv::record> records;
+          double last = 0.0;
+          csv::parse(*input, NULL,
+                     [&](const csv::record &record, double complete) -> bool {
+                       EXPECT_LE(last, complete);
+                       last = complete;
+                       records.push_back(record);
+                       return true;
+                     });
+          ASSERT_NO_FATAL_FAILURE(checkSameRecords(expected, records));
+          ASSERT_EQ(1.0, input->progress());
+
+          // Stopping early stops the thread, and a second parse carries on
+          // with the blocks it had read
+          if (input == &file) {
+            ASSERT_TRUE(file.open(url));
+          } else if (input == &fd) {
+            ASSERT_TRUE(fd.open(url));
+          } else {
+            ASSERT_TRUE(uring.open(url));
+          }
+          std::vector<std::vector<std::string>> contents;
+          const auto add = [&](const csv::record_view &record, double) {
+            std::vector<std::string> fields;
+            for (const auto &field : record) {
+              fields.emplace_back(field.content);
+            }
+            contents.push_back(fields);
+            return contents.size() != 2;
+          };
+          csv::structural::parse(*input, add);
+          csv::structural::parse(*input, add);
+          ASSERT_EQ(expected.size(), contents.size());
+          for (size_t i = 0; i < expected.size(); i++) {
+            ASSERT_EQ(expected[i].content.size(), contents[i].size());
+            for (size_t j = 0; j < contents[i].size(); j++) {
+              ASSERT_EQ(expected[i].content[j].content, contents[i][j]);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // Stopping part way through, with the reader blocked on a full ring
+  const auto url = getResource("orig.csv");
+  for (int attempt = 0; attempt < 2; attempt++) {
+    csv::utf8::FileDataSource input;
+    input.bufferSize = 16;
+    input.prefetch = true;
+    input.prefetchBuffers = 2;
+    ASSERT_TRUE(input.open(url));
+
+    size_t count = 0;
+    csv::parse(input, NULL, [&](const csv::record &, double) -> bool {
+      if (++count < 2) {
+        return true;
+      }
+      // Cancel, or stop from the callback
+      input.cancelled = (attempt == 0);
+      return attempt == 0;
+    });
+    ASSERT_EQ(2, count);
+    ASSERT_LT(input.progress(), 1.0);
+  }
+
+  // A pipe, written a few bytes at a time
+  csv::utf8::StringDataSource textInput("a,b\r\n1,\"2\n3\"\r\n");
+  const std::vector<csv::record> expected = AddRecords(textInput);
+
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  std::thread writer([fds]() {
+    const std::string data = "\xEF\xBB\xBF"
+                             "a,b\r\n1,\"2\n3\"\r\n";
+    for (char c : data) {
+      if (write(fds[1], &c, 1) != 1) {
+        break;
+      }
+    }
+    close(fds[1]);
+  });
+
+  csv::utf8::FdDataSource input;
+  input.bufferSize = 4;
+  input.prefetch = true;
+  ASSERT_TRUE(input.open(fds[0], true));
+  ASSERT_NO_FATAL_FAILURE(checkSameRecords(expected, AddRecords(input)));
+  writer.join();
+  ASSERT_EQ(1.0, input.progress());
+
+  // A pipe holding less than a block that stays open.  What has been written
+  // is delivered, and closing doesn't wait for the writer
+  ASSERT_EQ(0, pipe(fds));
+  ASSERT_EQ(9, write(fds[1], "a,b\r\n1,2\n", 9));
+
+  csv::utf8::FdDataSource idle;
+  idle.prefetch = true;
+  ASSERT_TRUE(idle.open(fds[0], true));
+  std::vector<csv::record> records;
+  csv::parse(idle, NULL, [&](const csv::record &record, double) -> bool {
+    records.push_back(record);
+    return records.size() < 2;
+  });
+  ASSERT_EQ(2, records.size());
+  ASSERT_EQ("1", records[1][0].content);
+  idle.close();
+  close(fds[1]);
+}
+
+TEST(CSVTests, GzipFileDataSource) {
+  if (!csv::utf8::GzipFileDataSource::supported()) {
+    GTEST_SKIP() << "Built without zlib";
+  }
+
+  // A single member, several members (split mid-record), BGZF, and several
+  // members with something that looks like a member header inside the first
+  const std::vector<std::pair<const char *, const char *>> files = {
+      {"classification.csv", "classification.csv.gz"},
+      {"classification.csv", "classification-members.csv.gz"},
+      {"classification.csv", "classification.csv.bgz"},
+      {"embedded-header.csv", "embedded-header.csv.gz"}};
+  for (const auto &[plain, name] : files) {
+    csv::utf8::MappedFileDataSource expectedInput(getResource(plain));
+    const std::vector<csv::record> expected = AddRecords(expectedInput);
+
+    const auto compressed = getResource(name);
+    ASSERT_FALSE(compressed.empty());
+
+    for (unsigned int threads : {1, 4}) {
+      for (size_t bufferSize : {3, 1024 * 1024}) {
+        SCOPED_TRACE(std::string(name) + " / " + std::to_string(threads) +
+                     " / " + std::to_string(bufferSize));
+
+        csv::utf8::GzipFileDataSource input;
+        input.threads = threads;
+        input.bufferSize = bufferSize;
+        ASSERT_TRUE(input.open(compressed));
+
+        std::vector<csv::record> records;
+        double last = 0.0;
+        csv::parse(input, NULL,
+                   [&](const csv::record &record, double complete) -> bool {
+                     EXPECT_LE(last, complete);
+                     last = complete;
+                     records.push_back(record);
+                     return true;
+                   });
+        ASSERT_NO_FATAL_FAILURE(checkSameRecords(expected, records));
+        ASSERT_EQ(1.0, input.progress());
+      }
+    }
+
+    // Detected by the plain file source
+    csv::utf8::FileDataSource input(compressed);
+    ASSERT_NO_FATAL_FAILURE(checkSameRecords(expected, AddRecords(input)));
+    input.threads = 4;
+    ASSERT_TRUE(input.open(compressed));
+    ASSERT_NO_FATAL_FAILURE(checkSameRecords(expected, AddRecords(input)));
+
+    input.decompress = false;
+    ASSERT_TRUE(input.open(compressed));
+    ASSERT_NE(expected.size(), AddRecords(input).size());
+  }
+
+  // Stopping part way through a file with several members
+  csv::utf8::GzipFileDataSource input;
+  input.threads = 4;
+  ASSERT_TRUE(input.open(getResource("classification.csv.bgz")));
+  size_t count = 0;
+  csv::parse(input, NULL,
+             [&](const csv::record &, double) -> bool { return ++count < 3; });
+  ASSERT_EQ(3, count);
+  input.close();
+
+  // Truncated part way through a member (the last one of the BGZF file) is
+  // reported as an error, after the records before it
+  for (const char *name : {"classification.csv.gz", "classification.csv.bgz"}) {
+    std::ifstream in(getResource(name), std::ios::binary);
+    const std::string content((std::istreambuf_iterator<char>(in)),
+                              std::istreambuf_iterator<char>());
+    const std::string path = TemporaryFile(
+        "csvlib_truncated.csv.gz", content.substr(0, content.size() - 40));
+    const RemoveFiles cleanup{{path}};
+
+    for (unsigned int threads : {1, 4}) {
+      SCOPED_TRACE(std::string(name) + " / " + std::to_string(threads));
+      csv::utf8::GzipFileDataSource truncated;
+      truncated.threads = threads;
+      ASSERT_TRUE(truncated.open(path));
+      size_t records = 0;
+      ASSERT_EQ(csv::State::Error,
+                csv::structural::parse(
+                    truncated, [&](const csv::record_view &, double) -> bool {
+                      records++;
+                      return true;
+                    }));
+      ASSERT_TRUE(truncated.failed());
+      ASSERT_LT(0, records);
+    }
+
+    csv::utf8::FileDataSource detected(path);
+    ASSERT_EQ(csv::State::Error, csv::structural::parse(detected, nullptr));
+    ASSERT_EQ(csv::State::Error,
+              csv::parse_files({getResource("orig.csv"), path}, 2, nullptr));
+    ASSERT_EQ(csv::State::Error, csv::parse_concatenated({path}, nullptr));
+  }
+
+  // Not compressed
+  ASSERT_FALSE(input.open(getResource("classification.csv")));
+  ASSERT_THROW(csv::utf8::GzipFileDataSource("/tmp/blah.12345"),
+               csv::file_exception);
+}
+
+TEST(CSVTests, ZstdFileDataSource) {
+  if (!csv::utf8::ZstdFileDataSource::supported()) {
+    GTEST_SKIP() << "Built without zstd";
+  }
+
+  const auto url = getResource("classification.csv");
+  ASSERT_FALSE(url.empty());
+  csv::utf8::MappedFileDataSource expectedInput(url);
+  const std::vector<csv::record> expected = AddRecords(expectedInput);
+
+  // A single frame, and the seekable format (frames split mid-record)
+  for (const char *name :
+       {"classification.csv.zst", "classification.seekable.csv.zst"}) {
+    const auto compressed = getResource(name);
+    ASSERT_FALSE(compressed.empty());
+
+    for (unsigned int threads : {1, 4}) {
+      for (size_t bufferSize : {3, 1024 * 1024}) {
+        SCOPED_TRACE(std::string(name) + " / " + std::to_string(threads) +
+                     " / " + std::to_string(bufferSize));
+
+        csv::utf8::ZstdFileDataSource input;
+        input.threads = threads;
+        input.bufferSize = bufferSize;
+        ASSERT_TRUE(input.open(compressed));
+
+        std::vector<csv::record> records;
+        double last = 0.0;
+        csv::parse(input, NULL,
+                   [&](const csv::record &record, double complete) -> bool {
+                     EXPECT_LE(last, complete);
+                     last = complete;
+                     records.push_back(record);
+                     return true;
+                   });
+        ASSERT_NO_FATAL_FAILURE(checkSameRecords(expected, records));
+        ASSERT_EQ(1.0, input.progress());
+      }
+    }
+  }
+
+  // Stopping part way through a seekable file
+  csv::utf8::ZstdFileDataSource input;
+  input.threads = 4;
+  ASSERT_TRUE(input.open(getResource("classification.seekable.csv.zst")));
+  size_t count = 0;
+  csv::parse(input, NULL,
+             [&](const csv::record &, double) -> bool { return ++count < 3; });
+  ASSERT_EQ(3, count);
+  input.close();
+
+  // Not compressed
+  ASSERT_FALSE(input.open(url));
+  ASSERT_THROW(csv::utf8::ZstdFileDataSource("/tmp/blah.12345"),
+               csv::file_exception);
+}
+
+TEST(CSVTests, ParseFiles) {
+  // Files of different sizes, including a compressed one
+  const std::vector<std::pair<const char *, const char *>> files = {
+      {"orig.csv", "orig.csv"},
+      {"korean.csv", "korean.csv"},
+      {"ford_escort.csv", "ford_escort.csv"},
+      {"classification.csv", "classification.csv.gz"},
+      {"korean-small.csv", "korean-small.csv"}};
+
+  std::vector<std::string> paths;
+  std::vector<std::vector<csv::record>> expected;
+  for (const auto &[plain, name] : files) {
+    csv::utf8::MappedFileDataSource expectedInput(getResource(plain));
+    expected.push_back(AddRecords(expectedInput));
+    paths.push_back(getResource(name));
+  }
+
+  for (size_t threads : {1, 3}) {
+    SCOPED_TRACE(threads);
+
+    std::mutex lock;
+    std::vector<std::vector<csv::record>> records(paths.size());
+    const csv::State state = csv::parse_files(
+        paths, threads,
+        [&](size_t file, const csv::record_view &record,
+            double complete) -> bool {
+          EXPECT_LT(0.0, complete);
+          EXPECT_GE(1.0, complete);
+          std::lock_guard<std::mutex> guard(lock);
+          records.at(file).push_back(record.to_record());
+          return true;
+        });
+    ASSERT_EQ(csv::State::Complete, state);
+
+    for (size_t file = 0; file < paths.size(); file++) {
+      SCOPED_TRACE(paths[file]);
+      ASSERT_NO_FATAL_FAILURE(checkSameRecords(expected[file], records[file]));
+    }
+  }
+
+  // Stopping
+  std::atomic<size_t> count{0};
+  ASSERT_EQ(csv::State::Complete,
+            csv::parse_files(paths, 3,
+                             [&](size_t, const csv::record_view &,
+                                 double) -> bool { return ++count < 10; }));
+  ASSERT_LE(10, count);
+  ASSERT_GT(100, count);
+
+  // Nothing is parsed if a file is missing
+  paths.push_back("/tmp/blah.12345");
+  count = 0;
+  ASSERT_EQ(csv::State::Error,
+            csv::parse_files(paths, 3,
+                             [&](size_t, const csv::record_view &,
+                                 double) -> bool { return ++count > 0; }));
+  ASSERT_EQ(0, count);
+}
+
+TEST(CSVTests, ParseConcatenated) {
+  // A repeated header, a file without a trailing line ending, one without
+  // a header, and an empty one
+  TemporaryFile("csvlib_concat_1.csv", "a,b\r\n1,2\r\n");
+  TemporaryFile("csvlib_concat_2.csv", "a,b\r\n3,\"4\n4\"");
+  TemporaryFile("csvlib_concat_3.csv", "5,6\r\n");
+  TemporaryFile("csvlib_concat_4.csv", "");
+  TemporaryFile("csvlib_concat_5.csv", "\xEF\xBB\xBF"
+                                       "a,b\n7,8\n");
+
+  const std::vector<std::string> paths = csv::glob(
+      (std::filesystem::temp_directory_path() / "csvlib_concat_*.csv")
+          .string());
+  const RemoveFiles cleanup{paths};
+  ASSERT_EQ(5, paths.size());
+  ASSERT_NE(std::string::npos, paths[0].find("csvlib_concat_1.csv"));
+  ASSERT_NE(std::string::npos, paths[4].find("csvlib_concat_5.csv"));
+  ASSERT_TRUE(csv::glob("/tmp/blah.12345*").empty());
+
+  for (bool dedupe : {true, false}) {
+    SCOPED_TRACE(dedupe);
+
+    csv::utf8::StringDataSource expectedInput(
+        dedupe ? "a,b\r\n1,2\r\n3,\"4\n4\"\r\n5,6\r\n7,8\n"
+               : "a,b\r\n1,2\r\na,b\r\n3,\"4\n4\"\r\n5,6\r\na,b\n7,8\n");
+    const std::vector<csv::record> expected = AddRecords(expectedInput);
+    const std::vector<size_t> expectedFiles =
+        dedupe ? std::vector<size_t>{0, 0, 1, 2, 4}
+               : std::vector<size_t>{0, 0, 1, 1, 2, 4, 4};
+
+    std::vector<csv::record> records;
+    std::vector<size_t> files;
+    double last = 0.0;
+    const csv::State state = csv::parse_concatenated(
+        paths,
+        [&](size_t file, const csv::record_view &record,
+            double complete) -> bool {
+          EXPECT_LE(last, complete);
+          last = complete;
+          for (const auto &field : record) {
+            EXPECT_EQ(record.row, field.row);
+          }
+          records.push_back(record.to_record());
+          files.push_back(file);
+          return true;
+        },
+        csv::structural::dialect(), dedupe);
+    ASSERT_EQ(csv::State::Complete, state);
+    ASSERT_NO_FATAL_FAILURE(checkSameRecords(expected, records));
+    ASSERT_EQ(expectedFiles, files);
+    ASSERT_EQ(1.0, last);
+  }
+
+  // When the first file is empty the header comes from the next one
+  {
+    csv::utf8::StringDataSource expectedInput("a,b\r\n3,\"4\n4\"\r\n1,2\r\n");
+    const std::vector<csv::record> expected = AddRecords(expectedInput);
+
+    std::vector<csv::record> records;
+    std::vector<size_t> files;
+    const csv::State state = csv::parse_concatenated(
+        {paths[3], paths[1], paths[0]},
+        [&](size_t file, const csv::record_view &record, double) -> bool {
+          records.push_back(record.to_record());
+          files.push_back(file);
+          return true;
+        },
+        csv::structural::dialect(), true);
+    ASSERT_EQ(csv::State::Complete, state);
+    ASSERT_NO_FATAL_FAILURE(checkSameRecords(expected, records));
+    ASSERT_EQ((std::vector<size_t>{1, 1, 2}), files);
+  }
+
+  ASSERT_EQ(csv::State::Error,
+            csv::parse_concatenated({paths[0], "/tmp/blah.12345"}, NULL));
+  ASSERT_EQ(csv::State::Error,
+            csv::parse_concatenated(
+                {paths[0], std::filesystem::temp_directory_path().string()},
+                NULL));
+}
+
+// Well formed CSV with quoted fields containing separators, quotes and line
+// endings.  The offset of each record is added to 'starts'
+std::string WellFormedCSV(std::mt19937 &random, size_t records,
+                          std::vector<size_t> &starts) {
+  static const char plain[] = "ab c";
+  static const char quoted[] = "ab ,\"\r\n";
+  std::uniform_int_distribution<size_t> pick(0, 99);
+  std::string text;
+  for (size_t record = 0; record < records; record++) {
+    starts.push_back(text.size());
+    const size_t fields = 1 + pick(random) % 4;
+    for (size_t field = 0; field < fields; field++) {
+      if (field > 0) {
+        text += ',';
+      }
+      const size_t length = pick(random) % 12;
+      if (pick(random) < 40) {
+        text += '\"';
+        for (size_t i = 0; i < length; i++) {
+          const char c = quoted[pick(random) % (sizeof(quoted) - 1)];
+          text += (c == '\"') ? "\"\"" : std::string(1, c);
+        }
+        text += '\"';
+      } else {
+        text += 'x';
+        for (size_t i = 0; i < length; i++) {
+          text += plain[pick(random) % (sizeof(plain) - 1)];
+        }
+      }
+    }
+    text += (pick(random) < 50) ? "\r\n" : "\n";
+  }
+  return text;
+}
+
+TEST(CSVTests, RangeFileDataSource) {
+  std::mt19937 random(2024);
+  std::vector<size_t> starts;
+  const std::string text = WellFormedCSV(random, 400, starts);
+  const std::string path = TemporaryFile("csvlib_range.csv", text);
+  const RemoveFiles cleanup{{path}};
+
+  csv::utf8::StringDataSource expectedInput(text);
+  const std::vector<csv::record> expected = AddRecords(expectedInput);
+
+  // Numbered in order, as if they came from a single source
+  const auto renumber = [](std::vector<csv::record> records) {
+    for (size_t i = 0; i < records.size(); i++) {
+      records[i].row = i;
+    }
+    return records;
+  };
+
+  for (size_t shards : {1, 2, 3, 7, 50, 1000}) {
+    for (bool aligned : {false, true}) {
+      SCOPED_TRACE(std::to_string(shards) + (aligned ? " aligned" : ""));
+
+      // Cut anywhere, or (with an index) at the start of a record
+      std::set<size_t> cuts = {0, text.size()};
+      std::uniform_int_distribution<size_t> anywhere(0, text.size());
+      std::uniform_int_distribution<size_t> record(0, starts.size() - 1);
+      const size_t limit = aligned ? starts.size() : text.size();
+      while (cuts.size() < std::min(shards, limit) + 1) {
+        cuts.insert(aligned ? starts[record(random)] : anywhere(random));
+      }
+
+      std::vector<csv::record> records;
+      size_t previous = 0;
+      for (auto cut = cuts.begin(); std::next(cut) != cuts.end(); ++cut) {
+        csv::utf8::RangeFileDataSource input;
+        input.aligned = aligned;
+        input.bufferSize = 7;
+        ASSERT_TRUE(input.open(path, *cut, *std::next(cut)));
+
+        // The ranges actually read are adjacent
+        ASSERT_EQ(previous, input.begin());
+        previous = input.end();
+
+        for (const csv::record &found : AddRecords(input)) {
+          records.push_back(found);
+        }
+        ASSERT_EQ(1.0, input.progress());
+      }
+      ASSERT_EQ(text.size(), previous);
+      ASSERT_NO_FATAL_FAILURE(checkSameRecords(expected, renumber(records)));
+    }
+  }
+
+  // A range inside a single record has nothing in it
+  csv::utf8::RangeFileDataSource input(path, starts[1] + 1, starts[1] + 2);
+  ASSERT_TRUE(AddRecords(input).empty());
+
+  ASSERT_THROW(csv::utf8::RangeFileDataSource("/tmp/blah.12345", 0, 10),
+               csv::file_exception);
+}
+
+// The number of records, the total size of their fields, and the first field
+// of the last record
+std::tuple<size_t, size_t, std::string> Summary(csv::utf8::DataSource &input,
+                                                bool structural) {
+  size_t rows = 0;
+  size_t size = 0;
+  std::string last;
+  const auto add = [&](const csv::record_view &record, double) -> bool {
+    rows++;
+    for (const auto &field : record) {
+      size += field.content.size();
+    }
+    last = std::string(record[0].content);
+    return true;
+  };
+  if (structural) {
+    EXPECT_EQ(csv::State::Complete, csv::structural::parse(input, add));
+  } else {
+    EXPECT_EQ(csv::State::Complete,
+              csv::parse(static_cast<csv::IDataSource &>(input), add));
+  }
+  return {rows, size, last};
+}
+
+TEST(CSVTests, FileAccessHints) {
+  // Just larger than the read-ahead window (8MiB, given again every 4MiB), so
+  // the hints are given several times and the mapped pages behind them dropped
+  std::string text = "\xEF\xBB\xBF";
+  size_t rows = 0;
+  size_t size = 0;
+  while (text.size() < 9 * 1024 * 1024) {
+    const std::string number = std::to_string(rows);
+    text += number + ",\"a,\r\nb\",some more text for the row\r\n";
+    size += number.size() + 5 + 26;
+    rows++;
+  }
+  const std::string path = TemporaryFile("csvlib_hints.csv", text);
+  const RemoveFiles cleanup{{path}};
+  const auto expected =
+      std::make_tuple(rows, size, std::to_string(rows - 1));
+
+  csv::utf8::FileDataSource file;
+  csv::utf8::FdDataSource fd;
+  csv::utf8::UringFileDataSource uring;
+  csv::utf8::RangeFileDataSource range;
+  for (bool dropConsumed : {false, true}) {
+    for (bool prefetch : {false, true}) {
+      for (csv::utf8::BufferedDataSource *input :
+           std::initializer_list<csv::utf8::BufferedDataSource *>{
+               &file, &fd, &uring, &range}) {
+        input->dropConsumed = dropConsumed;
+        input->prefetch = prefetch;
+        for (bool structural : {false, true}) {
+          SCOPED_TRACE(std::to_string(dropConsumed) + " / " +
+                       std::to_string(prefetch) + " / " +
+                       std::to_string(structural));
+          if (input == &file) {
+            ASSERT_TRUE(file.open(path));
+          } else if (input == &fd) {
+            ASSERT_TRUE(fd.open(path));
+          } else if (input == &uring) {
+            ASSERT_TRUE(uring.open(path));
+          } else {
+            range.aligned = true;
+            ASSERT_TRUE(range.open(path, 3, text.size()));
+          }
+          ASSERT_EQ(expected, Summary(*input, structural));
+          ASSERT_EQ(1.0, input->progress());
+        }
+      }
+    }
+
+    for (bool hugePages : {false, true}) {
+      for (bool structural : {false, true}) {
+        csv::utf8::MappedFileDataSource mapped;
+        mapped.dropConsumed = dropConsumed;
+        mapped.hugePages = hugePages;
+        ASSERT_TRUE(mapped.open(path));
+        ASSERT_EQ(expected, Summary(mapped, structural));
+        ASSERT_EQ(1.0, mapped.progress());
+      }
+    }
+  }
+
+  // Stepping back across the point at which the hints are given
+  csv::utf8::MappedFileDataSource mapped;
+  mapped.dropConsumed = true;
+  ASSERT_TRUE(mapped.open(path));
+  for (size_t i = 3; i < 5 * 1024 * 1024; i++) {
+    ASSERT_TRUE(mapped.next());
+    ASSERT_EQ(text[i] == '\"', mapped.is_quote());
+    if (text[i] == '\"') {
+      mapped.back();
+      ASSERT_TRUE(mapped.next());
+      ASSERT_TRUE(mapped.is_quote());
+    }
+  }
+}
+
+TEST(CSVTests, DirectFileDataSource) {
+  for (const char *name :
+       {"orig.csv", "simple_csv_utf8_bom.tsv", "classification.csv.gz"}) {
+    const auto url = getResource(name);
+    ASSERT_FALSE(url.empty());
+    const char separator =
+        (url.find(".tsv") != std::string::npos) ? '\t' : ',';
+
+    csv::utf8::FileDataSource expectedInput(url);
+    expectedInput.separator = separator;
+    const std::vector<csv::record> expected = AddRecords(expectedInput);
+
+    for (size_t bufferSize : {3, 4096, 1024 * 1024}) {
+      for (bool prefetch : {false, true}) {
+        SCOPED_TRACE(std::string(name) + " / " + std::to_string(bufferSize) +
+                     " / " + std::to_string(prefetch));
+        csv::utf8::FileDataSource input;
+        input.separator = separator;
+        input.bufferSize = bufferSize;
+        input.prefetch = prefetch;
+        input.directIO = true;
+        ASSERT_TRUE(input.open(url));
+        ASSERT_NO_FATAL_FAILURE(checkSameRecords(expected, AddRecords(input)));
+        ASSERT_EQ(1.0, input.progress());
+      }
+    }
+  }
+
+  // Several blocks and an unaligned tail, starting with a BOM
+  std::string text = "\xEF\xBB\xBF";
+  for (size_t row = 0; text.size() < 3 * 4096 + 123; row++) {
+    text += std::to_string(row) + ",\"x\ny\",z\n";
+  }
+  const std::string path = TemporaryFile("csvlib_direct.csv", text);
+  const RemoveFiles cleanup{{path}};
+  csv::utf8::StringDataSource textInput(text);
+  const std::vector<csv::record> expected = AddRecords(textInput);
+  for (size_t bufferSize : {100, 4096, 5000, 64 * 1024}) {
+    SCOPED_TRACE(bufferSize);
+    csv::utf8::FileDataSource input;
+    input.bufferSize = bufferSize;
+    input.directIO = true;
+    ASSERT_TRUE(input.open(path));
+    ASSERT_NO_FATAL_FAILURE(checkSameRecords(expected, AddRecords(input)));
+    ASSERT_EQ(1.0, input.progress());
+  }
+
+  // Only used when asked for, and never for gzip compressed files
+  csv::utf8::FileDataSource input;
+  ASSERT_TRUE(input.open(getResource("orig.csv")));
+  ASSERT_FALSE(input.direct());
+  input.directIO = true;
+  ASSERT_TRUE(input.open(getResource("classification.csv.gz")));
+  ASSERT_FALSE(input.direct());
+}
+
+TEST(CSVTests, RowIndex) {
+  // Quoted line endings, both kinds of line ending and blank lines
+  std::string text = "\xEF\xBB\xBF";
+  for (size_t row = 0; row < 500; row++) {
+    text += std::to_string(row);
+    text += (row % 3 == 0) ? ",\"a\r\nb\"" : ",c";
+    text += (row % 2 == 0) ? "\r\n" : "\n";
+    if (row % 11 == 0) {
+      text += "\n";
+    }
+  }
+  text += "last,\"no line ending\"";
+  const std::string path = TemporaryFile("csvlib_index.csv", text);
+  std::filesystem::remove(csv::index::sidecar(path));
+  const RemoveFiles cleanup{{path, csv::index::sidecar(path)}};
+
+  csv::utf8::StringDataSource textInput(text);
+  const std::vector<csv::record> expected = AddRecords(textInput);
+
+  csv::index::row_index index;
+  ASSERT_FALSE(csv::index::load(path, index));
+  ASSERT_TRUE(csv::index::build(path, csv::structural::dialect(), 7));
+  ASSERT_TRUE(std::filesystem::exists(csv::index::sidecar(path)));
+  ASSERT_TRUE(csv::index::load(path, index));
+  ASSERT_EQ(expected.size(), index.rows);
+  ASSERT_EQ(7, index.interval);
+  ASSERT_EQ((expected.size() + 6) / 7, index.offsets.size());
+  ASSERT_EQ(3, index.offsets[0]);
+  ASSERT_EQ(text.size(), csv::index::locate(path, index, expected.size()));
+
+  for (const auto &[first, last] : std::vector<std::pair<size_t, size_t>>{
+           {0, 1}, {0, 7}, {6, 8}, {7, 14}, {13, 200}, {250, 250},
+           {490, 501}, {499, 1000}, {501, 501}, {2000, 3000}, {3, -1}}) {
+    SCOPED_TRACE(std::to_string(first) + " - " + std::to_string(last));
+    csv::utf8::RangeFileDataSource source;
+    ASSERT_TRUE(csv::index::seek(source, path, index, first, last));
+
+    std::vector<csv::record> slice;
+    for (size_t row = first; row < std::min(last, expected.size()); row++) {
+      slice.push_back(expected[row]);
+      slice.back().row -= first;
+    }
+    ASSERT_NO_FATAL_FAILURE(checkSameRecords(slice, AddRecords(source)));
+  }
+
+  // Each record can be found from the closest entry before it
+  for (size_t row = 0; row < expected.size(); row++) {
+    csv::utf8::RangeFileDataSource source;
+    ASSERT_TRUE(csv::index::seek(source, path, index, row, row + 1));
+    const std::vector<csv::record> records = AddRecords(source);
+    ASSERT_EQ(1, records.size());
+    ASSERT_EQ(expected[row][0].content, records[0][0].content);
+  }
+
+  // Every record counts when blank lines aren't skipped
+  csv::structural::dialect options;
+  options.skipBlankLines = false;
+  ASSERT_TRUE(csv::index::build(path, index, options, 5));
+  ASSERT_EQ(expected.size() + 46, index.rows);
+
+  // The index is out of date once the file changes
+  {
+    std::ofstream out(path, std::ios::binary | std::ios::app);
+    out << "\n1,2\n";
+  }
+  ASSERT_FALSE(csv::index::load(path, index));
+
+  ASSERT_FALSE(csv::index::build("/tmp/blah.12345"));
+}
+
+TEST(CSVTests, RowIndexUpdate) {
+  const std::string path = TemporaryFile("csvlib_log.csv", "a,b\r\n1,\"x\ny\"");
+  std::filesystem::remove(csv::index::sidecar(path));
+  const RemoveFiles cleanup{{path, csv::index::sidecar(path)}};
+  ASSERT_FALSE(csv::index::update(path));
+  ASSERT_TRUE(csv::index::build(path, csv::structural::dialect(), 3));
+  csv::index::row_index updated;
+  ASSERT_TRUE(csv::index::load(path, updated));
+
+  // Pieces appended to the file, which split records (including a CR LF
+  // pair) and quoted fields between updates
+  const std::vector<std::string> pieces = {
+      "\n",        "2,3\r",     "\n3,4\n\n", "4,\"5",  "\r\n6\"\n5,6\r\n",
+      "6,7\n7,8\n", "",          "8,9\r",     "\r",     "\n9,\"\"\n10",
+      ",11\n",     "11,12\n12"};
+  for (const std::string &piece : pieces) {
+    SCOPED_TRACE(piece);
+    {
+      std::ofstream out(path, std::ios::binary | std::ios::app);
+      out << piece;
+    }
+
+    ASSERT_TRUE(csv::index::update(path, updated));
+
+    csv::index::row_index built;
+    ASSERT_TRUE(csv::index::build(path, built, csv::structural::dialect(), 3));
+    ASSERT_EQ(built.rows, updated.rows);
+    ASSERT_EQ(built.offsets, updated.offsets);
+    ASSERT_EQ(built.tail, updated.tail);
+    ASSERT_EQ(built.tailRows, updated.tailRows);
+    ASSERT_EQ(built.checksum, updated.checksum);
+
+    csv::utf8::FileDataSource input(path);
+    const std::vector<csv::record> expected = AddRecords(input);
+    ASSERT_EQ(expected.size(), updated.rows);
+    for (size_t first = 0; first < expected.size(); first++) {
+      csv::utf8::RangeFileDataSource source;
+      ASSERT_TRUE(csv::index::seek(source, path, updated, first, first + 2));
+      std::vector<csv::record> slice;
+      for (size_t row = first; row < std::min(first + 2, expected.size());
+           row++) {
+        slice.push_back(expected[row]);
+        slice.back().row -= first;
+      }
+      ASSERT_NO_FATAL_FAILURE(checkSameRecords(slice, AddRecords(source)));
+    }
+  }
+
+  // Bringing the sidecar file up to date
+  csv::index::row_index index;
+  ASSERT_FALSE(csv::index::load(path, index));
+  ASSERT_TRUE(csv::index::update(path));
+  ASSERT_TRUE(csv::index::load(path, index));
+  ASSERT_EQ(updated.offsets, index.offsets);
+
+  // Changed rather than appended to, so the index is built again
+  TemporaryFile("csvlib_log.csv", "x,y\r\n1,2\r\n3,4\r\n5,6\r\n7,8\r\n9");
+  ASSERT_FALSE(csv::index::update(path, index));
+  ASSERT_TRUE(csv::index::update(path));
+  ASSERT_TRUE(csv::index::load(path, index));
+  ASSERT_EQ(6, index.rows);
+  ASSERT_EQ(3, index.interval);
+  ASSERT_EQ(2, index.offsets.size());
+  ASSERT_EQ(15, index.offsets[1]);
+
+  // Shorter
+  TemporaryFile("csvlib_log.csv", "x,y\r\n");
+  ASSERT_FALSE(csv::index::update(path, index));
+}
+
+TEST(CSVTests, FollowFile) {
+  const std::string path = TemporaryFile("csvlib_follow.csv", "\xEF\xBB");
+  const RemoveFiles cleanup{{path}};
+
+  csv::utf8::FileDataSource file;
+  csv::utf8::FdDataSource fd;
+  csv::utf8::UringFileDataSource uring;
+  for (csv::utf8::BufferedDataSource *input :
+       std::initializer_list<csv::utf8::BufferedDataSource *>{&file, &fd,
+                                                              &uring}) {
+    for (bool prefetch : {false, true}) {
+      for (bool structural : {false, true}) {
+        SCOPED_TRACE(std::to_string(prefetch) + " / " +
+                     std::to_string(structural));
+        TemporaryFile("csvlib_follow.csv", "\xEF\xBB");
+
+        input->follow = true;
+        input->followInterval = 20;
+        input->prefetch = prefetch;
+        input->bufferSize = 8;
+        if (input == &file) {
+          ASSERT_TRUE(file.open(path));
+        } else if (input == &fd) {
+          ASSERT_TRUE(fd.open(path));
+        } else {
+          ASSERT_TRUE(uring.open(path));
+          ASSERT_FALSE(uring.asynchronous());
+        }
+
+        // Written in pieces that split the BOM, a quoted field and the
+        // final record
+        std::atomic<bool> ended{false};
+        std::thread writer([&]() {
+          for (const char *piece :
+               {"\xBF", "a,b\n1,\"x", "\ny\"\r\n2,3\n4,5", "6"}) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(30));
+            std::ofstream out(path, std::ios::binary | std::ios::app);
+            out << piece;
+          }
+          std::this_thread::sleep_for(std::chrono::milliseconds(30));
+          ended = true;
+          std::ofstream out(path, std::ios::binary | std::ios::app);
+          out << "\n";
+        });
+
+        std::vector<std::vector<std::string>> records;
+        const auto add = [&](const csv::record_view &record, double) {
+          std::vector<std::string> fields;
+          for (const auto &field : record) {
+            fields.emplace_back(field.content);
+          }
+          records.push_back(fields);
+
+          // The last record is only delivered once it is complete
+          return records.size() < 4;
+        };
+        if (structural) {
+          csv::structural::parse(*input, add);
+        } else {
+          csv::parse(static_cast<csv::IDataSource &>(*input), add);
+        }
+        writer.join();
+
+        ASSERT_TRUE(ended);
+        const std::vector<std::vector<std::string>> expected = {
+            {"a", "b"}, {"1", "x\ny"}, {"2", "3"}, {"4", "56"}};
+        ASSERT_EQ(expected, records);
+
+        // The settings are changed for the next pass, so close the source
+        // first
+        if (input == &file) {
+          file.close();
+        } else if (input == &fd) {
+          fd.close();
+        } else {
+          uring.close();
+        }
+      }
+    }
+  }
+
+  // Following stops when the file is truncated
+  TemporaryFile("csvlib_follow.csv", "a,b\n");
+  csv::utf8::FileDataSource input;
+  input.follow = true;
+  ASSERT_TRUE(input.open(path));
+  std::thread truncate([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::filesystem::resize_file(path, 0);
+  });
+  ASSERT_EQ(1, AddRecords(input).size());
+  truncate.join();
+
+  // Following stops when the source is cancelled from another thread, with
+  // or without prefetch
+  for (bool prefetch : {false, true}) {
+    TemporaryFile("csvlib_follow.csv", "a,b\n");
+    csv::utf8::FileDataSource cancelled;
+    cancelled.follow = true;
+    cancelled.followInterval = 20;
+    cancelled.prefetch = prefetch;
+    ASSERT_TRUE(cancelled.open(path));
+
+    // Parsing clears the flag when it starts, so keep setting it until the
+    // parse returns
+    std::atomic<bool> parsed{false};
+    std::thread cancel([&]() {
+      while (!parsed) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        cancelled.cancelled = true;
+      }
+    });
+    ASSERT_EQ(1, AddRecords(cancelled).size());
+    parsed = true;
+    cancel.join();
+  }
+
+  // A range has a fixed end
+  TemporaryFile("csvlib_follow.csv", "a,b\n1,2\n");
+  csv::utf8::RangeFileDataSource range;
+  range.follow = true;
+  ASSERT_TRUE(range.open(path, 0, 4));
+  ASSERT_EQ(1, AddRecords(range).size());
+}
+
+TEST(CSVTests, Checkpoint) {
+  // Quoted line endings, all three kinds of line ending and blank lines
+  std::string text = "\xEF\xBB\xBF";
+  for (size_t row = 0; row < 60; row++) {
+    text += std::to_string(row);
+    text += (row % 3 == 0) ? ",\"a\r\nb\"" : ",c";
+    text += (row % 4 == 0) ? "\r\n" : (row % 4 == 1) ? "\r" : "\n";
+    if (row % 7 == 0 && row % 4 != 1) {
+      text += "\n";
+    }
+  }
+  text += "last,\"no line ending\"";
+  const std::string path = TemporaryFile("csvlib_checkpoint.csv", text);
+  const RemoveFiles cleanup{{path}};
+
+  csv::utf8::StringDataSource textInput(text);
+  const std::vector<csv::record> expected = AddRecords(textInput);
+
+  const auto open =
+      [&](size_t kind) -> std::unique_ptr<csv::utf8::DataSource> {
+    if (kind == 0) {
+      return std::make_unique<csv::utf8::StringDataSource>(text);
+    }
+    if (kind == 1) {
+      auto input = std::make_unique<csv::utf8::MappedFileDataSource>();
+      EXPECT_TRUE(input->open(path));
+      return input;
+    }
+    if (kind == 2 || kind == 3 || kind == 6) {
+      auto input = std::make_unique<csv::utf8::FileDataSource>();
+      input->bufferSize = 7;
+      input->prefetch = (kind == 3);
+      input->directIO = (kind == 6);
+      EXPECT_TRUE(input->open(path));
+      return input;
+    }
+    if (kind == 4) {
+      auto input = std::make_unique<csv::utf8::FdDataSource>();
+      input->bufferSize = 5;
+      EXPECT_TRUE(input->open(path));
+      return input;
+    }
+    auto input = std::make_unique<csv::utf8::UringFileDataSource>();
+    input->bufferSize = 6;
+    input->queueDepth = 2;
+    EXPECT_TRUE(input->open(path));
+    return input;
+  };
+
+  bool carriageReturn = false;
+  for (size_t kind = 0; kind < 7; kind++) {
+    for (size_t stop = 0; stop <= expected.size(); stop++) {
+      SCOPED_TRACE(std::to_string(kind) + " / " + std::to_string(stop));
+
+      // Parse part of the way, keeping the checkpoint after the last record
+      std::vector<csv::record> records;
+      csv::checkpoint saved;
+      std::unique_ptr<csv::utf8::DataSource> input = open(kind);
+      ASSERT_EQ(csv::State::Complete,
+                csv::parse(*input, csv::checkpoint(),
+                           [&](const csv::record_view &record,
+                               const csv::checkpoint &next, double) {
+                             if (records.size() == stop) {
+                               return false;
+                             }
+                             records.push_back(record.to_record());
+                             saved = next;
+                             carriageReturn |= next.carriageReturn;
+                             return true;
+                           }));
+      if (stop == expected.size()) {
+        ASSERT_EQ(text.size(), saved.offset);
+      }
+
+      // Carry on from there with a new source
+      csv::checkpoint from;
+      ASSERT_TRUE(csv::checkpoint::deserialize(saved.serialize(), from));
+      ASSERT_EQ(saved.offset, from.offset);
+      ASSERT_EQ(saved.row, from.row);
+      ASSERT_EQ(saved.carriageReturn, from.carriageReturn);
+
+      input = open(kind);
+      ASSERT_EQ(csv::State::Complete,
+                csv::parse(*input, from,
+                           [&](const csv::record_view &record,
+                               const csv::checkpoint &, double) {
+                             records.push_back(record.to_record());
+                             return true;
+                           }));
+      checkSameRecords(expected, records);
+    }
+  }
+
+  // A carriage return at the end of a block was carried over at least once
+  ASSERT_TRUE(carriageReturn);
+
+  csv::checkpoint from;
+  ASSERT_FALSE(csv::checkpoint::deserialize("not a checkpoint", from));
+
+  // A pipe can't be seeked
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  ASSERT_EQ((ssize_t)text.size(), write(fds[1], text.data(), text.size()));
+  close(fds[1]);
+  from.offset = 10;
+  csv::utf8::FdDataSource piped;
+  ASSERT_TRUE(piped.open(fds[0], true));
+  ASSERT_EQ(csv::State::Error, csv::parse(piped, from, nullptr));
+}
+
+TEST(CSVTests, Sample) {
+  // Records of varying length, with quoted line endings and blank lines.  The
+  // first field of each record is its row number
+  std::string text;
+  for (size_t row = 0; row < 20000; row++) {
+    text += std::to_string(row) + ",";
+    text += (row % 5 == 0) ? "\"quoted\r\nline\"" : "plain";
+    text += "," + std::string(row % 97, 'p');
+    text += (row % 2 == 0) ? "\r\n" : "\n";
+    if (row % 13 == 0) {
+      text += "\n";
+    }
+  }
+  const std::string path = TemporaryFile("csvlib_sample.csv", text);
+  std::filesystem::remove(csv::index::sidecar(path));
+  const RemoveFiles cleanup{{path, csv::index::sidecar(path)}};
+
+  std::vector<csv::record> expected;
+  csv::utf8::StringDataSource textInput(text);
+  csv::structural::parse(textInput, nullptr,
+                         [&](const csv::record &record, double) {
+                           expected.push_back(record);
+                           return true;
+                         });
+  ASSERT_EQ(20000, expected.size());
+
+  const auto rowOf = [](const csv::record &record) {
+    return (size_t)std::stoul(record[0].content);
+  };
+
+  // Random offsets (the file is too large to be worth reading in full)
+  ASSERT_TRUE(csv::sample(path, 0, 1).empty());
+  const std::vector<csv::record> offsets = csv::sample(path, 8, 1);
+  ASSERT_EQ(8, offsets.size());
+  for (size_t i = 0; i < offsets.size(); i++) {
+    ASSERT_EQ(csv::unknownRow, offsets[i].row);
+    ASSERT_TRUE(i == 0 || rowOf(offsets[i - 1]) < rowOf(offsets[i]));
+
+    csv::record found = expected[rowOf(offsets[i])];
+    found.row = csv::unknownRow;
+    for (auto &field : found.content) {
+      field.row = csv::unknownRow;
+    }
+    checkSameRecords({found}, {offsets[i]});
+  }
+
+  const auto rows = [&](const std::vector<csv::record> &records) {
+    std::vector<size_t> result;
+    for (const auto &record : records) {
+      result.push_back(rowOf(record));
+    }
+    return result;
+  };
+  ASSERT_EQ(rows(offsets), rows(csv::sample(path, 8, 1)));
+  ASSERT_NE(rows(offsets), rows(csv::sample(path, 8, 2)));
+
+  // Exactly, using an index
+  ASSERT_TRUE(csv::index::build(path, csv::structural::dialect(), 64));
+  const std::vector<csv::record> indexed = csv::sample(path, 50, 3);
+  ASSERT_EQ(50, indexed.size());
+  std::vector<csv::record> picked;
+  for (size_t i = 0; i < indexed.size(); i++) {
+    ASSERT_TRUE(i == 0 || indexed[i - 1].row < indexed[i].row);
+    picked.push_back(expected[indexed[i].row]);
+  }
+  checkSameRecords(picked, indexed);
+
+  double total = 0;
+  for (uint64_t seed = 0; seed < 200; seed++) {
+    total += (double)csv::sample(path, 1, seed)[0].row;
+  }
+  ASSERT_NEAR(10000.0, total / 200, 1500.0);
+
+  // The index isn't used for another dialect
+  csv::structural::dialect options;
+  options.skipBlankLines = false;
+  ASSERT_EQ(csv::unknownRow, csv::sample(path, 1, 4, options)[0].row);
+
+  // A source that is read through (every record equally likely)
+  const std::string shortText = text.substr(0, text.find("\n100,"));
+  std::vector<size_t> counts(100, 0);
+  for (uint64_t seed = 0; seed < 500; seed++) {
+    csv::utf8::StringDataSource input(shortText);
+    const std::vector<csv::record> records = csv::sample(input, 10, seed);
+    ASSERT_EQ(10, records.size());
+    for (size_t i = 0; i < records.size(); i++) {
+      ASSERT_TRUE(i == 0 || records[i - 1].row < records[i].row);
+      checkSameRecords({expected[records[i].row]}, {records[i]});
+      counts[records[i].row]++;
+    }
+  }
+  for (const size_t count : counts) {
+    ASSERT_GT(count, 20);
+    ASSERT_LT(count, 90);
+  }
+
+  csv::utf8::StringDataSource all(shortText);
+  checkSameRecords(
+      std::vector<csv::record>(expected.begin(), expected.begin() + 100),
+      csv::sample(all, 1000, 5));
+
+  // A small file is read in full, so the row numbers are known
+  const std::string smallPath =
+      TemporaryFile("csvlib_sample_small.csv", shortText);
+  const RemoveFiles smallCleanup{{smallPath}};
+  const std::vector<csv::record> small = csv::sample(smallPath, 3, 6);
+  ASSERT_EQ(3, small.size());
+  checkSameRecords({expected[small[0].row]}, {small[0]});
+
+  ASSERT_TRUE(csv::sample("/does/not/exist.csv", 3, 7).empty());
+}
@@ -0,0 +1,52 @@
+//
+//  bytes.hpp
+//
+//  MIT license
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+//  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all copies or substantial
+//  portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+//  WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+//  OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+//  OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+
+// Reading and writing the little endian numbers used by the serialized formats (the row index sidecar files
+// and checkpoints).  Internal to the library, so not installed.
+
+namespace csv::bytes {
+
+	/// Append 'value' to 'out' as 8 little endian bytes
+	inline void put(std::string& out, uint64_t value) {
+		for (size_t i = 0; i < 8; i++) {
+			out.push_back((char)(value >> (i * 8)));
+		}
+	}
+
+	/// Read 8 little endian bytes at 'position' in 'in' into 'value', and move 'position' past them.  Returns
+	/// false if there aren't 8 bytes left
+	inline bool get(std::string_view in, size_t& position, uint64_t& value) {
+		if (position > in.size() || in.size() - position < 8) {
+			return false;
+		}
+		value = 0;
+		for (size_t i = 0; i < 8; i++) {
+			value |= (uint64_t)(uint8_t)in[position + i] << (i * 8);
+		}
+		position += 8;
+		return true;
+	}
+};
@@ -0,0 +1,73 @@
+//
+//  checkpoint.cpp
+//
+//  MIT license
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+//  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all copies or substantial
+//  portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+//  WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+//  OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+//  OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "checkpoint.hpp"
+#include "structural.hpp"
+#include "bytes.hpp"
+
+#include <algorithm>
+
+namespace {
+
+	// A serialized checkpoint is the magic bytes and the format version, the offset and the row (little endian),
+	// and a byte of flags
+	const char _MAGIC[] = { 'C', 'S', 'V', 'C', 'K', 'P', 'T', '\1' };
+	const size_t _MAGIC_SIZE = sizeof(_MAGIC);
+	const size_t _SERIALIZED_SIZE = _MAGIC_SIZE + 8 + 8 + 1;
+};
+
+namespace csv {
+
+	std::string checkpoint::serialize() const {
+		std::string out(_MAGIC, _MAGIC_SIZE);
+		bytes::put(out, offset);
+		bytes::put(out, row);
+		out.push_back(carriageReturn ? 1 : 0);
+		return out;
+	}
+
+	bool checkpoint::deserialize(std::string_view data, checkpoint& result) {
+		if (data.size() != _SERIALIZED_SIZE || !std::equal(_MAGIC, _MAGIC + _MAGIC_SIZE, data.begin()) ||
+			(uint8_t)data[_SERIALIZED_SIZE - 1] > 1) {
+			return false;
+		}
+
+		size_t position = _MAGIC_SIZE;
+		bytes::get(data, position, result.offset);
+		bytes::get(data, position, result.row);
+		result.carriageReturn = (data[_SERIALIZED_SIZE - 1] != 0);
+		return true;
+	}
+
+	State parse(utf8::DataSource& source, const checkpoint& from, CheckpointCallback emitRecord) {
+		const bool skipBlankLines = source.skipBlankLines;
+
+		structural::cursor records(source, from);
+		while (records.next()) {
+			const csv::record_view& view = records.record();
+			if (skipBlankLines && view.empty()) {
+				continue;
+			}
+			if (emitRecord && !emitRecord(view, records.checkpoint(), source.progress())) {
+				return State::Complete;
+			}
+		}
+		return records.state();
+	}
+};
@@ -0,0 +1,75 @@
+//
+//  checkpoint.hpp
+//
+//  MIT license
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+//  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all copies or substantial
+//  portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+//  WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+//  OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+//  OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#pragma once
+
+#include <csv/parser.hpp>
+#include <csv/datasource/utf8/DataSource.hpp>
+
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+#include <string_view>
+
+// Checkpoints, so that a long parse can carry on from where it got to (eg. after a crash or a restart) rather
+// than from the start of the input.
+//
+//     csv::checkpoint from;
+//     csv::checkpoint::deserialize(saved, from);
+//     csv::utf8::FileDataSource source("big.csv");
+//     csv::parse(source, from, [&](const csv::record_view& record, const csv::checkpoint& next, double progress) {
+//         ... store 'record', and every so often 'next.serialize()' along with it
+//         return true;
+//     });
+
+namespace csv {
+
+	/// Where a parse of an input had got to: the start of the next record.
+	///
+	/// Checkpoints are only taken between records, where the parser is never inside a quoted field.  The only
+	/// other state to carry over is a carriage return ending the previous record, which a line feed may follow.
+	struct checkpoint {
+		/// The offset in the input of the next record
+		uint64_t offset = 0;
+
+		/// The row number of the next record
+		uint64_t row = 0;
+
+		/// The previous record ended with a carriage return at the end of the input read so far, so a line feed
+		/// at 'offset' still belongs to it
+		bool carriageReturn = false;
+
+		/// The checkpoint as a (fixed size) string of bytes, to be stored along with the results of the parse
+		std::string serialize() const;
+
+		/// Read a checkpoint written by serialize().  Returns false if 'data' isn't one
+		static bool deserialize(std::string_view data, checkpoint& result);
+	};
+
+	typedef std::function<bool(const record_view&, const checkpoint& next, double progress)> CheckpointCallback;
+
+	/// Parse a UTF-8 data source from 'from' -- a checkpoint passed to the callback by an earlier parse of the
+	/// same input with the same dialect, or the start of the input -- passing each record along with the
+	/// checkpoint to carry on from after it.  Rows are numbered as if parsing had started from the beginning.
+	/// Returns State::Error if the source can't be seeked to the checkpoint.
+	///
+	/// Uses the two-stage parser (see csv::structural), which produces the same records as csv::parse.
+	csv::State parse(utf8::DataSource& source, const checkpoint& from, CheckpointCallback emitRecord);
+};
@@ -22,6 +22,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <string>
 #include <vector>
 #include <assert.h>
@@ -54,8 +55,10 @@ public:
 	/// Ignore (step over) blank lines rather than return a blank record for empty lines
 	bool skipBlankLines = true;
 
-	/// Set to true to cancel the current parsing
-	bool cancelled = false;
+	/// Set to true to cancel the current parsing.  Can be set from another thread (eg. to stop following a
+	/// file).  The parser only checks it with relaxed loads, so it doesn't order any other data.  Being atomic,
+	/// it makes data sources neither copyable nor movable
+	std::atomic<bool> cancelled{false};
 
 	/// Move to the next character.  Returns 'false' if EOF is found
 	virtual bool next() = 0;
@@ -82,8 +85,18 @@ public:
 	/// Returns the UTF-8 representation of current field
 	virtual std::string field() const = 0;
 
+	/// Append the UTF-8 representation of the current field to 'out'.  Override to avoid the temporary
+	/// string returned by field()
+	virtual void append_field(std::string& out) const {
+		out += field();
+	}
+
 	// Progress through parsing (0.0 -> 1.0)
 	virtual double progress() = 0;
+
+	/// Called when a parse of the source returns (at the end of the input, or when it stops early), so that the
+	/// source can stop reading ahead.  A later parse carries on from where this one stopped
+	virtual void parse_ended() {}
 };
 
 };
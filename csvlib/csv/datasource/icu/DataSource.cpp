@@ -29,29 +29,16 @@
 namespace csv {
 namespace icu {
 
-	bool DataSource::is_eol() {
-		if (_current == '\r') {
-			if (next() == false) {
-				// Hit the end of file.  Return true and let the caller handle it
-				return true;
-			}
-
-			if (_current != '\n') {
-				back();
-			}
-			return true;
-		}
-		else if (_current == '\n') {
-			return true;
-		}
-		return false;
-	}
-
 	std::string DataSource::field() const {
 		std::string converted;
 		_field.toUTF8String(converted);
 		return converted;
 	}
+
+	void DataSource::append_field(std::string& out) const {
+		// toUTF8String() appends
+		_field.toUTF8String(out);
+	}
 };
 
 namespace icu {
@@ -90,33 +77,6 @@ namespace icu {
 	FileDataSource::~FileDataSource() {
 		u_fclose(_in);
 	}
-
-	bool FileDataSource::next() {
-		if (u_feof(_in)) {
-			return false;
-		}
-
-		_prev = _current;
-		_current = u_fgetc(_in);
-
-		return true;
-	}
-
-	void FileDataSource::back() {
-		u_fungetc(_current, _in);
-		_current = _prev;
-		_prev = 0;
-	}
-
-	double FileDataSource::progress() {
-		// ICU appears to perform buffering from the underlying file handle in order to optimize reading
-		// As such this method is not byte-accurate as it will depend on how much data ICU buffers during reading
-		// So, for small files the progress will always be 1.0, however for larger files it will chunk.
-		FILE* internal_file = u_fgetfile(_in);
-		double pos = ftell(internal_file);
-		double len = _length;
-		return std::min(pos / len, 1.0);
-	}
 };
 
 namespace icu {
@@ -134,29 +94,6 @@ namespace icu {
 		_in = U_ICU_NAMESPACE::UnicodeString(text.c_str(), (int)(text.length()), cp.c_str());
 		return true;
 	}
-
-	bool StringDataSource::next() {
-		_offset++;
-		if (_offset >= _in.length()) {
-			return false;
-		}
-
-		_prev = _current;
-		_current = _in[_offset];
-		return true;
-	}
-
-	void StringDataSource::back() {
-		_current = _prev;
-		_prev = 0;
-		_offset--;
-	}
-
-	double StringDataSource::progress() {
-		double pos = _offset;
-		double len = _in.length();
-		return std::min(pos / len, 1.0);
-	}
 };
 };
 
@@ -29,6 +29,9 @@
 #include <unicode/unistr.h>
 #include <unicode/ustdio.h>
 
+#include <algorithm>
+#include <stdio.h>
+
 namespace csv {
 namespace icu {
 
@@ -39,9 +42,26 @@ namespace icu {
 		UChar32 separator = ',';
 		UChar32 comment = '\0';
 
-	protected:
-		virtual bool is_eol();
+	public:
+		// The per-character methods are defined here so that a parse over a concrete source can inline them
+
+		inline virtual bool is_eol() {
+			if (_current == '\r') {
+				if (next() == false) {
+					// Hit the end of file.  Return true and let the caller handle it
+					return true;
+				}
+
+				if (_current != '\n') {
+					back();
+				}
+				return true;
+			}
+			return _current == '\n';
+		}
+
 		virtual std::string field() const;
+		virtual void append_field(std::string& out) const;
 
 		inline virtual bool is_separator() const {
 			return _current == separator;
@@ -75,7 +95,7 @@ namespace icu {
 		U_ICU_NAMESPACE::UnicodeString _field;
 	};
 
-	class FileDataSource: public DataSource {
+	class FileDataSource final: public DataSource {
 	public:
 		FileDataSource() noexcept
 		: _in(NULL) {
@@ -94,17 +114,39 @@ namespace icu {
 
 		virtual ~FileDataSource();
 
-	protected:
-		virtual bool next();
-		virtual void back();
-		virtual double progress();
+	public:
+		inline virtual bool next() {
+			if (u_feof(_in)) {
+				return false;
+			}
+
+			_prev = _current;
+			_current = u_fgetc(_in);
+			return true;
+		}
+
+		inline virtual void back() {
+			u_fungetc(_current, _in);
+			_current = _prev;
+			_prev = 0;
+		}
+
+		inline virtual double progress() {
+			// ICU appears to perform buffering from the underlying file handle in order to optimize reading
+			// As such this method is not byte-accurate as it will depend on how much data ICU buffers during reading
+			// So, for small files the progress will always be 1.0, however for larger files it will chunk.
+			FILE* internal_file = u_fgetfile(_in);
+			double pos = ftell(internal_file);
+			double len = _length;
+			return std::min(pos / len, 1.0);
+		}
 
 	private:
 		UFILE* _in;
 		long long _length;
 	};
 
-	class StringDataSource: public DataSource {
+	class StringDataSource final: public DataSource {
 	public:
 		StringDataSource() noexcept : _offset(-1) {}
 		StringDataSource(const std::string& data, const char* codepage) {
@@ -115,10 +157,29 @@ namespace icu {
 
 		bool set(const std::string& text, const char* codepage);
 
-	protected:
-		virtual bool next();
-		virtual void back();
-		virtual double progress();
+	public:
+		inline virtual bool next() {
+			_offset++;
+			if (_offset >= _in.length()) {
+				return false;
+			}
+
+			_prev = _current;
+			_current = _in[_offset];
+			return true;
+		}
+
+		inline virtual void back() {
+			_current = _prev;
+			_prev = 0;
+			_offset--;
+		}
+
+		inline virtual double progress() {
+			double pos = _offset;
+			double len = _in.length();
+			return std::min(pos / len, 1.0);
+		}
 
 	private:
 		U_ICU_NAMESPACE::UnicodeString _in;
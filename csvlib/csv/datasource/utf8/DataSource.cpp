@@ -23,7 +23,33 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#ifdef CSV_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef CSV_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef CSV_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
 #include <limits>
+#include <mutex>
 #include <array>
 
 #include "DataSource.hpp"
@@ -37,104 +63,2121 @@ namespace utf8 {
 	static const std::string _BOMS = { '\xEF', '\xBB', '\xBF' };
 	static const size_t _BOMS_SIZE = 3;
 
+	// How far ahead of the parser the kernel is asked to read the file.  The hints are repeated each time the
+	// parser gets through half of it
+	static const size_t _HINT_WINDOW = 8 * 1024 * 1024;
+
 	DataSource::DataSource() noexcept {
 		_field.reserve(256);
 	}
+};
+};
+
+// MARK: - UTF8 buffered source
+
+namespace csv {
+namespace utf8 {
+
+	BufferedDataSource::~BufferedDataSource() {
+		reset();
+	}
+
+	void BufferedDataSource::reset() {
+		stopPrefetch();
+
+		_length = -1;
+		_exhausted = false;
+		_failed = false;
+		_checkBOM = false;
+		_position = 0;
+		_end = 0;
+		_base = 0;
+
+		_file = -1;
+		_fileOffset = 0;
+		_hinted = 0;
+		_dropped = 0;
+		_drop = false;
+
+		_following = false;
+		if (_watch >= 0) {
+			::close(_watch);
+			_watch = -1;
+		}
+	}
+
+	void BufferedDataSource::start(long long length, int fd, size_t offset, bool toEnd) {
+		reset();
+		_length = length;
+
+		if (fd >= 0) {
+			_file = fd;
+			_fileOffset = offset;
+			_drop = dropConsumed;
+
+			// Only whole pages are dropped, so start from the one the input starts in
+			_dropped = offset - (offset % (size_t)::sysconf(_SC_PAGESIZE));
+#ifdef POSIX_FADV_SEQUENTIAL
+			::posix_fadvise(fd, (off_t)offset, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+			struct stat info;
+			if (follow && toEnd && ::fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+				// The size keeps changing
+				_following = true;
+				_followInterval = followInterval;
+				_length = -1;
+				watch();
+			}
+		}
+
+		_buffer.resize(1 + std::max(bufferSize, _BOMS_SIZE));
+		_prev = 0;
+
+		startPrefetch();
+
+		_checkBOM = true;
+		if (!_following) {
+			// Read the first block now.  (A file being followed may not have anything in it yet, so that waits
+			// until the first read.)
+			refill();
+		}
+	}
+
+	bool BufferedDataSource::seek(size_t offset) {
+		if (_length >= 0 && offset > (size_t)_length) {
+			return false;
+		}
+
+		// The prefetch thread must not be reading while the input is moved
+		stopPrefetch();
+		_position = 0;
+		_end = 0;
+		_prev = 0;
+
+		if (!reposition(_fileOffset + offset)) {
+			// Leave the source at the end of the input
+			_exhausted = true;
+			return false;
+		}
+
+		// Carry on as though the input had been read up to 'offset'
+		_exhausted = false;
+		_checkBOM = false;
+		_base = offset;
+		_hinted = offset;
+		if (_drop) {
+			const size_t position = _fileOffset + offset;
+			_dropped = position - (position % (size_t)::sysconf(_SC_PAGESIZE));
+		}
+
+		startPrefetch();
+		if (!_following) {
+			refill();
+		}
+		return true;
+	}
+
+	bool BufferedDataSource::refill() {
+		do {
+			if (_exhausted) {
+				return false;
+			}
+
+			if (_end > 0) {
+				// Keep the last character of the block we are leaving so we can step back onto it
+				_buffer[0] = _buffer[_end - 1];
+				_base += _end - 1;
+			}
+
+			const size_t count = readBlock();
+
+			// The 'current' character is always _buffer[0] once a new block has been read
+			_position = 0;
+			_end = 1 + count;
+			_exhausted = (count == 0);
+
+			if (_checkBOM && count > 0) {
+				skipBOM();
+			}
+
+			if (_file >= 0 && (_base >= _hinted || _exhausted)) {
+				hint();
+			}
+
+			// Go on to the next block if the first one was just a BOM
+		} while (_position + 1 >= _end);
+		return true;
+	}
+
+	void BufferedDataSource::skipBOM() {
+		_checkBOM = false;
+
+		// A pipe can return less than was asked for, so make sure there's enough to check for a BOM.  (The
+		// prefetch thread only hands over a short block at the end of the input.)
+		while (_end - 1 < _BOMS_SIZE && !_exhausted && !_reader.joinable()) {
+			const size_t count = input(&_buffer[_end], _buffer.size() - _end);
+			_end += count;
+			_exhausted = (count == 0);
+		}
+
+		if (_end - 1 >= _BOMS_SIZE && memcmp(_BOMS.c_str(), &_buffer[1], _BOMS_SIZE) == 0) {
+			// We have a BOM. The 'current' character is the last character of the BOM
+			_position = _BOMS_SIZE;
+		}
+	}
+
+	size_t BufferedDataSource::input(char* buffer, size_t size) {
+		while (true) {
+			const size_t count = read(buffer, size);
+			if (count > 0 || _failed || !_following || !waitForInput()) {
+				return count;
+			}
+		}
+	}
+
+	void BufferedDataSource::watch() {
+#ifdef __linux__
+		// Watch the file itself (by way of its descriptor) rather than its name, as 'tail -f' does
+		_watch = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (_watch < 0) {
+			return;
+		}
+		const std::string path = "/proc/self/fd/" + std::to_string(_file);
+		if (::inotify_add_watch(_watch, path.c_str(), IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE) < 0) {
+			// Check for changes every '_followInterval' instead
+			::close(_watch);
+			_watch = -1;
+		}
+#endif
+	}
+
+	bool BufferedDataSource::waitForInput() {
+		while (!cancelled.load(std::memory_order_relaxed) && !_stopping.load(std::memory_order_acquire)) {
+			const off_t position = ::lseek(_file, 0, SEEK_CUR);
+			struct stat info;
+			if (position < 0 || ::fstat(_file, &info) != 0 || info.st_size < position) {
+				// The file has been truncated, so stop following it
+				return false;
+			}
+			if (info.st_size > position) {
+				return true;
+			}
+
+			if (_watch >= 0) {
+				struct pollfd ready = { _watch, POLLIN, 0 };
+				if (::poll(&ready, 1, (int)_followInterval) > 0) {
+					// Discard the events.  The size is checked again anyway
+					char events[4096];
+					while (::read(_watch, events, sizeof(events)) > 0) {
+					}
+				}
+			}
+			else {
+				std::this_thread::sleep_for(std::chrono::milliseconds(_followInterval));
+			}
+		}
+		return false;
+	}
+
+	void BufferedDataSource::hint() {
+		// Everything before the current block has been parsed
+		const size_t position = _fileOffset + _base;
+		_hinted = _base + _HINT_WINDOW / 2;
+
+#ifdef POSIX_FADV_WILLNEED
+		if (!_exhausted) {
+			// Ask for the file to be read in ahead of the parser
+			::posix_fadvise(_file, (off_t)position, (off_t)_HINT_WINDOW, POSIX_FADV_WILLNEED);
+		}
+
+		if (_drop && position > _dropped) {
+			::posix_fadvise(_file, (off_t)_dropped, (off_t)(position - _dropped), POSIX_FADV_DONTNEED);
+
+			// The page the position is in has only been partly parsed, so is dropped next time
+			_dropped = position - (position % (size_t)::sysconf(_SC_PAGESIZE));
+		}
+#endif
+	}
+
+	size_t BufferedDataSource::readBlock() {
+		const size_t taken = _taken.load(std::memory_order_relaxed);
+		size_t produced = _produced.load(std::memory_order_acquire);
+		if (produced == taken && !_reader.joinable()) {
+			// No prefetch thread, or it has been stopped and its blocks have all been taken
+			return input(&_buffer[1], _buffer.size() - 1);
+		}
+
+		// Wait for the prefetch thread to fill the next block
+		while (produced == taken) {
+			_produced.wait(produced, std::memory_order_acquire);
+			produced = _produced.load(std::memory_order_acquire);
+		}
+
+		// Swap it in, and hand our old buffer back to the thread
+		block& filled = _ring[taken % _ring.size()];
+		filled.buffer[0] = _buffer[0];
+		std::swap(_buffer, filled.buffer);
+		const size_t count = filled.count;
+
+		_taken.store(taken + 1, std::memory_order_release);
+		_taken.notify_one();
+		return count;
+	}
+
+	void BufferedDataSource::startPrefetch() {
+		if (!prefetch) {
+			return;
+		}
+
+		_ring.resize(std::max<size_t>(prefetchBuffers, 1));
+		for (auto& entry: _ring) {
+			entry.buffer.resize(_buffer.size());
+			entry.count = 0;
+		}
+
+		// A read from a pipe or socket can block indefinitely, so the thread waits for it with poll() instead,
+		// which stopPrefetch() can interrupt
+		struct stat info;
+		const int fd = descriptor();
+		if (fd >= 0 && ::fstat(fd, &info) == 0 && !S_ISREG(info.st_mode) && ::pipe(_wake) == 0) {
+			_stream = fd;
+		}
+
+		_reader = std::thread(&BufferedDataSource::prefetchInput, this);
+	}
+
+	void BufferedDataSource::prefetchInput() {
+		const size_t depth = _ring.size();
+		bool ended = false;
+
+		for (size_t produced = 0; ; produced++) {
+			// Wait for a free block
+			size_t taken = _taken.load(std::memory_order_acquire);
+			while (produced - taken >= depth && !_stopping.load(std::memory_order_acquire)) {
+				_taken.wait(taken, std::memory_order_acquire);
+				taken = _taken.load(std::memory_order_acquire);
+			}
+			if (_stopping.load(std::memory_order_acquire)) {
+				return;
+			}
+
+			// Fill it completely, unless the input ends first.  If the thread is stopped part way, hand over
+			// what has been read (for parse_ended(), which keeps the blocks)
+			block& empty = _ring[produced % depth];
+			const size_t capacity = empty.buffer.size() - 1;
+			size_t count = 0;
+			while (!ended && count < capacity) {
+				if (_stopping.load(std::memory_order_acquire) || !readable()) {
+					break;
+				}
+				const size_t length = read(&empty.buffer[1 + count], capacity - count);
+				count += length;
+				if (length > 0) {
+					// Hand over what a pipe has rather than waiting for it to fill the block.  (The first block
+					// needs to be long enough to check for a BOM.)
+					if (_stream >= 0 && (produced > 0 || count >= _BOMS_SIZE)) {
+						break;
+					}
+					continue;
+				}
+
+				// At the end of a file being followed, hand over what there is rather than waiting for more.
+				// (The first block needs to be long enough to check for a BOM.)
+				if (_following && count > 0 && (produced > 0 || count >= _BOMS_SIZE)) {
+					break;
+				}
+				ended = _failed || !_following || !waitForInput();
+			}
+
+			// Stopping isn't the end of the input, so doesn't hand over an empty block
+			const bool stopping = _stopping.load(std::memory_order_acquire);
+			if (stopping && count == 0) {
+				return;
+			}
+
+			empty.count = count;
+			_produced.store(produced + 1, std::memory_order_release);
+			_produced.notify_one();
+
+			if (stopping || count == 0) {
+				// Stopped, or the empty block marking the end of the input has been handed over
+				return;
+			}
+		}
+	}
+
+	bool BufferedDataSource::readable() {
+		if (_stream < 0) {
+			return true;
+		}
+
+		// Wait for input, or to be woken by stopPrefetch()
+		struct pollfd ready[2] = { { _stream, POLLIN, 0 }, { _wake[0], POLLIN, 0 } };
+		while (::poll(ready, 2, -1) < 0 && errno == EINTR) {
+		}
+		return !_stopping.load(std::memory_order_acquire);
+	}
+
+	void BufferedDataSource::joinPrefetch() {
+		// Wake the thread if it is waiting for a free block, or for input.  (Moving _taken on wakes it from
+		// waiting for a free block, and is undone once it has stopped.)
+		_stopping.store(true, std::memory_order_release);
+		_taken.fetch_add(1, std::memory_order_acq_rel);
+		_taken.notify_one();
+		if (_stream >= 0) {
+			const char wake = 0;
+			while (::write(_wake[1], &wake, 1) < 0 && errno == EINTR) {
+			}
+		}
+		_reader.join();
+		_taken.fetch_sub(1, std::memory_order_acq_rel);
+
+		if (_stream >= 0) {
+			::close(_wake[0]);
+			::close(_wake[1]);
+			_wake[0] = _wake[1] = -1;
+			_stream = -1;
+		}
+		_stopping.store(false);
+	}
+
+	void BufferedDataSource::stopPrefetch() {
+		if (_reader.joinable()) {
+			joinPrefetch();
+		}
+
+		// Discard any blocks left from a thread stopped by parse_ended()
+		_ring.clear();
+		_produced.store(0);
+		_taken.store(0);
+	}
+
+	void BufferedDataSource::parse_ended() {
+		if (_reader.joinable()) {
+			joinPrefetch();
+		}
+	}
+
+	double BufferedDataSource::progress() {
+		if (_length < 0) {
+			// Unknown size
+			return _exhausted ? 1.0 : 0.0;
+		}
+		if (_length == 0) {
+			return 1.0;
+		}
+		double pos = _base + _position;
+		double len = _length;
+		return std::min(pos / len, 1.0);
+	}
+
+	bool BufferedDataSource::fill(const char*& data, size_t& size) {
+		if (_position + 1 >= _end && !refill()) {
+			return false;
+		}
+
+		data = &_buffer[_position + 1];
+		size = _end - _position - 1;
+		return true;
+	}
+};
+};
+
+// MARK: - Compressed file decoders
+
+namespace csv {
+namespace utf8 {
+
+#if defined(CSV_HAVE_ZLIB) || defined(CSV_HAVE_ZSTD)
+
+	namespace {
+
+		// The most decompressed content the workers for one file hold at once.  It is shared between the members
+		// they can work on, and a member that decompresses to more than its share is left to be streamed
+		const size_t _BUFFER_LIMIT = 256 * 1024 * 1024;
+
+		/// A member (or frame) of a compressed file, and the result of decompressing it on a worker thread
+		struct member {
+			size_t begin = 0;
+			size_t end = 0;
+
+			// The expected size of the content (if known)
+			size_t expected = 0;
+
+			bool done = false;
+			bool ok = false;
+			std::vector<char> data;
+		};
+
+		/// Map all of 'file' into memory.  Returns nullptr if it cannot be mapped (eg. it is empty or isn't a
+		/// regular file)
+		const unsigned char* mapFile(const char* file, size_t& size) {
+			const int fd = ::open(file, O_RDONLY);
+			if (fd < 0) {
+				return nullptr;
+			}
+
+			struct stat info;
+			if (::fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0) {
+				::close(fd);
+				return nullptr;
+			}
+
+			void* mapped = ::mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+			// The mapping holds its own reference to the file
+			::close(fd);
+
+			if (mapped == MAP_FAILED) {
+				return nullptr;
+			}
+			size = (size_t)info.st_size;
+			return (const unsigned char*)mapped;
+		}
+
+		/// Decompresses the members of a file on worker threads, staying at most two members per thread ahead of
+		/// the member being read
+		class member_pool {
+		public:
+			~member_pool() { stop(); }
+
+			/// Start decompressing 'members' using 'threads' threads.  'decompress' fills in a member's content
+			/// (and end, if not known) up to the size limit it is given, returning false if it fails
+			void start(std::vector<member> members, unsigned int threads, std::function<bool(member&, size_t)> decompress) {
+				_members = std::move(members);
+				_decompress = decompress;
+				_window = threads * 2;
+
+				// The members in the window, and the one being read
+				_limit = _BUFFER_LIMIT / (_window + 1);
+				for (size_t i = 0; i < std::min<size_t>(threads, _members.size()); i++) {
+					_workers.emplace_back(&member_pool::run, this);
+				}
+			}
+
+			/// Wait for the workers to finish the members they are working on
+			void stop() {
+				{
+					std::lock_guard<std::mutex> guard(_lock);
+					_stopped = true;
+					_changed.notify_all();
+				}
+				for (auto& worker: _workers) {
+					worker.join();
+				}
+				_workers.clear();
+			}
+
+			/// The member starting at 'offset' once it has been decompressed, or nullptr if no member starts there
+			/// (or it failed).  Members starting before 'offset' are discarded
+			member* take(size_t offset) {
+				while (_next < _members.size() && _members[_next].begin <= offset) {
+					member& piece = _members[_next];
+					{
+						std::unique_lock<std::mutex> guard(_lock);
+						_changed.wait(guard, [&]() { return piece.done; });
+						_next++;
+						_changed.notify_all();
+					}
+
+					if (piece.begin == offset && piece.ok) {
+						return &piece;
+					}
+
+					// Not a member after all (it was inside the previous one), or it failed
+					piece.data = std::vector<char>();
+				}
+				return nullptr;
+			}
+
+		private:
+			void run() {
+				while (true) {
+					const size_t index = _claimed++;
+					if (index >= _members.size()) {
+						return;
+					}
+
+					{
+						std::unique_lock<std::mutex> guard(_lock);
+						_changed.wait(guard, [&]() { return _stopped || index < _next + _window; });
+						if (_stopped) {
+							return;
+						}
+					}
+
+					member& piece = _members[index];
+					const bool ok = _decompress(piece, _limit);
+
+					std::lock_guard<std::mutex> guard(_lock);
+					piece.ok = ok;
+					piece.done = true;
+					_changed.notify_all();
+				}
+			}
+
+			std::vector<member> _members;
+			std::function<bool(member&, size_t)> _decompress;
+			size_t _next = 0;
+			size_t _window = 0;
+			size_t _limit = 0;
+			std::atomic<size_t> _claimed{0};
+			std::vector<std::thread> _workers;
+			std::mutex _lock;
+			std::condition_variable _changed;
+			bool _stopped = false;
+		};
+	};
+
+#endif
+
+#ifdef CSV_HAVE_ZLIB
+
+	namespace {
+
+		// The smallest possible gzip member (an empty one)
+		const size_t _GZIP_MEMBER_MIN = 20;
+
+		/// True if 'data' starts with what looks like a gzip member header
+		bool isGzipHeader(const unsigned char* data, size_t size) {
+			return size >= _GZIP_MEMBER_MIN && data[0] == 0x1f && data[1] == 0x8b && data[2] == 8 && (data[3] & 0xe0) == 0;
+		}
+
+		/// The size of the BGZF block starting at 'data' (taken from the 'BC' field of its header), or 0 if it
+		/// isn't one
+		size_t bgzfBlockSize(const unsigned char* data, size_t size) {
+			const unsigned char FEXTRA = 0x04;
+			if (!isGzipHeader(data, size) || (data[3] & FEXTRA) == 0) {
+				return 0;
+			}
+
+			const size_t extra = 12 + (data[10] | (data[11] << 8));
+			for (size_t field = 12; field + 4 <= extra && extra <= size; ) {
+				const size_t length = data[field + 2] | (data[field + 3] << 8);
+				if (data[field] == 'B' && data[field + 1] == 'C' && length == 2 && field + 6 <= extra) {
+					const size_t block = (data[field + 4] | (data[field + 5] << 8)) + 1;
+					return (block >= _GZIP_MEMBER_MIN && block <= size) ? block : 0;
+				}
+				field += 4 + length;
+			}
+			return 0;
+		}
+
+		/// A zlib stream that inflates a gzip member
+		struct inflater {
+			z_stream stream {};
+			bool valid = false;
+
+			inflater() { valid = (inflateInit2(&stream, 15 + 16) == Z_OK); }
+			~inflater() {
+				if (valid) {
+					inflateEnd(&stream);
+				}
+			}
+
+			inflater(const inflater&) = delete;
+			inflater& operator=(const inflater&) = delete;
+
+			/// Inflate from 'in' into 'out'.  Returns the zlib status, with the number of bytes used and
+			/// produced in 'used' and 'produced'
+			int inflate(const unsigned char* in, size_t inSize, char* out, size_t outSize, size_t& used, size_t& produced) {
+				stream.next_in = const_cast<Bytef*>(in);
+				stream.avail_in = (uInt)std::min<size_t>(inSize, std::numeric_limits<uInt>::max());
+				stream.next_out = (Bytef*)out;
+				stream.avail_out = (uInt)std::min<size_t>(outSize, std::numeric_limits<uInt>::max());
+
+				const uInt availableIn = stream.avail_in;
+				const uInt availableOut = stream.avail_out;
+				const int status = ::inflate(&stream, Z_NO_FLUSH);
+				used = availableIn - stream.avail_in;
+				produced = availableOut - stream.avail_out;
+				return status;
+			}
+		};
+
+		/// Inflate the gzip member at the start of 'data' into 'piece'.  Fails if it is corrupt (or isn't really
+		/// a member), or is larger than 'limit'
+		bool inflateMember(const unsigned char* data, size_t size, member& piece, size_t limit) {
+			inflater z;
+			if (!z.valid) {
+				return false;
+			}
+
+			piece.data.resize(std::clamp<size_t>(piece.expected, 1, std::min<size_t>(limit, 256 * 1024)));
+			size_t in = 0;
+			size_t out = 0;
+			while (true) {
+				if (out == piece.data.size()) {
+					if (out >= limit) {
+						return false;
+					}
+					piece.data.resize(std::min(out * 2, limit));
+				}
+
+				size_t used = 0;
+				size_t produced = 0;
+				const int status = z.inflate(data + in, size - in, piece.data.data() + out, piece.data.size() - out, used, produced);
+				in += used;
+				out += produced;
+
+				if (status == Z_STREAM_END) {
+					piece.data.resize(out);
+					piece.end = piece.begin + in;
+					return true;
+				}
+				if (status != Z_OK || (used == 0 && produced == 0)) {
+					return false;
+				}
+			}
+		}
+	};
+
+	struct gzip_decoder {
+		~gzip_decoder();
+
+		/// Map the file.  Returns false if it cannot be mapped or isn't gzip compressed
+		bool open(const char* file, unsigned int threads);
+
+		/// Decompress up to 'size' bytes into 'buffer'.  Returns 0 at the end of the file
+		size_t read(char* buffer, size_t size);
+
+		/// The fraction of the compressed file used so far
+		double progress() const;
+
+		/// Set if the file ended early because it is corrupt or truncated
+		bool failed = false;
+
+	private:
+		std::vector<member> findMembers() const;
+
+		const unsigned char* _data = nullptr;
+		size_t _size = 0;
+
+		// The offset of the next member to decompress, or of the rest of the member being streamed
+		size_t _offset = 0;
+		std::atomic<size_t> _position{0};
+
+		// Decompression on the calling thread, directly into the caller's buffer
+		inflater _stream;
+		bool _streaming = false;
+
+		// Decompression on worker threads, and the worker's result being read
+		member_pool _pool;
+		member* _current = nullptr;
+		size_t _taken = 0;
+	};
+
+	gzip_decoder::~gzip_decoder() {
+		_pool.stop();
+		if (_data != nullptr) {
+			::munmap((void*)_data, _size);
+		}
+	}
+
+	bool gzip_decoder::open(const char* file, unsigned int threads) {
+		_data = mapFile(file, _size);
+		if (_data == nullptr || !isGzipHeader(_data, _size) || !_stream.valid) {
+			return false;
+		}
+
+		if (threads == 0) {
+			threads = std::max(1U, std::thread::hardware_concurrency());
+		}
+		if (threads > 1) {
+			std::vector<member> members = findMembers();
+			if (members.size() > 1) {
+				_pool.start(std::move(members), threads, [this](member& piece, size_t limit) {
+					return inflateMember(_data + piece.begin, _size - piece.begin, piece, limit);
+				});
+			}
+		}
+		return true;
+	}
+
+	std::vector<member> gzip_decoder::findMembers() const {
+		std::vector<member> members;
+		if (bgzfBlockSize(_data, _size) > 0) {
+			// BGZF.  Each block's header gives its size, and its trailer the size of its content
+			for (size_t offset = 0, block = 0; (block = bgzfBlockSize(_data + offset, _size - offset)) > 0; offset += block) {
+				members.emplace_back();
+				members.back().begin = offset;
+				const unsigned char* trailer = _data + offset + block - 4;
+				members.back().expected = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | ((size_t)trailer[3] << 24);
+			}
+		}
+		else {
+			// Anything that looks like a member header.  Each is checked when the member before it ends
+			for (const unsigned char* found = _data; found != nullptr; ) {
+				if (isGzipHeader(found, _size - (found - _data))) {
+					members.emplace_back();
+					members.back().begin = found - _data;
+				}
+				found = (const unsigned char*)memchr(found + 1, 0x1f, _size - (found + 1 - _data));
+			}
+		}
+		return members;
+	}
+
+	size_t gzip_decoder::read(char* buffer, size_t size) {
+		while (true) {
+			if (_current != nullptr) {
+				const size_t count = std::min(size, _current->data.size() - _taken);
+				if (count > 0) {
+					memcpy(buffer, _current->data.data() + _taken, count);
+					_taken += count;
+					return count;
+				}
+
+				_current->data = std::vector<char>();
+				_current = nullptr;
+				_position = _offset;
+			}
+
+			if (_streaming) {
+				size_t used = 0;
+				size_t produced = 0;
+				const int status = _stream.inflate(_data + _offset, _size - _offset, buffer, size, used, produced);
+				_offset += used;
+				_position = _offset;
+
+				if (status == Z_STREAM_END) {
+					_streaming = false;
+				}
+				else if (status != Z_OK || (used == 0 && produced == 0)) {
+					// Corrupt or truncated.  Nothing after it can be read
+					_streaming = false;
+					_offset = _size;
+					failed = true;
+				}
+
+				if (produced > 0) {
+					return produced;
+				}
+				continue;
+			}
+
+			if (!isGzipHeader(_data + _offset, _size - _offset)) {
+				// The end of the file.  Anything after the last member is ignored (as gzip does)
+				_position = _size;
+				return 0;
+			}
+
+			// Use a worker's result if one started here, otherwise inflate the member here
+			if ((_current = _pool.take(_offset)) != nullptr) {
+				_taken = 0;
+				_offset = _current->end;
+			}
+			else {
+				inflateReset(&_stream.stream);
+				_streaming = true;
+			}
+		}
+	}
+
+	double gzip_decoder::progress() const {
+		return (double)_position / (double)_size;
+	}
+
+	bool GzipFileDataSource::supported() {
+		return true;
+	}
+
+#else
+
+	// Built without zlib
+	struct gzip_decoder {
+		bool open(const char*, unsigned int) { return false; }
+		size_t read(char*, size_t) { return 0; }
+		double progress() const { return 1.0; }
+		bool failed = false;
+	};
+
+	bool GzipFileDataSource::supported() {
+		return false;
+	}
+
+#endif
+
+#ifdef CSV_HAVE_ZSTD
+
+	namespace {
+
+		// Magic numbers from the zstd seekable format
+		const uint32_t _ZSTD_SEEK_TABLE_MAGIC = 0x184D2A5E;
+		const uint32_t _ZSTD_SEEKABLE_MAGIC = 0x8F92EAB1;
+		const size_t _ZSTD_SEEK_TABLE_FOOTER = 9;
+
+		uint32_t readLE32(const unsigned char* data) {
+			return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+		}
+
+		/// The frames listed in the seek table at the end of a file in the zstd seekable format, or nothing if
+		/// there isn't one
+		std::vector<member> seekTable(const unsigned char* data, size_t size) {
+			std::vector<member> frames;
+			if (size < _ZSTD_SEEK_TABLE_FOOTER + 8 || readLE32(data + size - 4) != _ZSTD_SEEKABLE_MAGIC) {
+				return frames;
+			}
+
+			// The footer gives the number of frames, and whether each entry has a checksum
+			const size_t count = readLE32(data + size - _ZSTD_SEEK_TABLE_FOOTER);
+			const size_t entry = (data[size - 5] & 0x80) ? 12 : 8;
+			const size_t table = (count * entry) + _ZSTD_SEEK_TABLE_FOOTER;
+			if (table + 8 > size) {
+				return frames;
+			}
+
+			// The table is a skippable frame
+			const unsigned char* header = data + size - table - 8;
+			if (readLE32(header) != _ZSTD_SEEK_TABLE_MAGIC || readLE32(header + 4) != table) {
+				return frames;
+			}
+
+			size_t offset = 0;
+			for (size_t index = 0; index < count; index++) {
+				const unsigned char* fields = header + 8 + (index * entry);
+				frames.emplace_back();
+				frames.back().begin = offset;
+				offset += readLE32(fields);
+				frames.back().end = offset;
+				frames.back().expected = readLE32(fields + 4);
+			}
+
+			if (offset != (size_t)(header - data)) {
+				// Doesn't describe this file
+				frames.clear();
+			}
+			return frames;
+		}
+
+		/// Decompress the frame described by 'piece'.  Fails if it is corrupt, or larger than 'limit'
+		bool decompressFrame(const unsigned char* data, member& piece, size_t limit) {
+			thread_local std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> context(ZSTD_createDCtx(), ZSTD_freeDCtx);
+			if (context == nullptr || piece.expected > limit) {
+				return false;
+			}
+
+			piece.data.resize(piece.expected);
+			const size_t length = ZSTD_decompressDCtx(context.get(), piece.data.data(), piece.data.size(), data + piece.begin, piece.end - piece.begin);
+			return !ZSTD_isError(length) && length == piece.expected;
+		}
+	};
+
+	struct zstd_decoder {
+		~zstd_decoder();
+
+		/// Map the file.  Returns false if it cannot be mapped or isn't zstd compressed
+		bool open(const char* file, unsigned int threads);
+
+		/// Decompress up to 'size' bytes into 'buffer'.  Returns 0 at the end of the file
+		size_t read(char* buffer, size_t size);
+
+		/// The fraction of the compressed file used so far
+		double progress() const;
+
+		/// Set if the file ended early because it is corrupt or truncated
+		bool failed = false;
+
+	private:
+		const unsigned char* _data = nullptr;
+		size_t _size = 0;
+
+		// The offset of the next frame to decompress, or of the rest of the frame being streamed
+		size_t _offset = 0;
+		std::atomic<size_t> _position{0};
+
+		// Decompression on the calling thread, directly into the caller's buffer
+		ZSTD_DCtx* _stream = nullptr;
+		bool _streaming = false;
+
+		// Decompression on worker threads, and the worker's result being read
+		member_pool _pool;
+		member* _current = nullptr;
+		size_t _taken = 0;
+	};
+
+	zstd_decoder::~zstd_decoder() {
+		_pool.stop();
+		ZSTD_freeDCtx(_stream);
+		if (_data != nullptr) {
+			::munmap((void*)_data, _size);
+		}
+	}
+
+	bool zstd_decoder::open(const char* file, unsigned int threads) {
+		_data = mapFile(file, _size);
+		if (_data == nullptr || _size < 4 || readLE32(_data) != ZSTD_MAGICNUMBER) {
+			return false;
+		}
+
+		_stream = ZSTD_createDCtx();
+		if (_stream == nullptr) {
+			return false;
+		}
+
+		if (threads == 0) {
+			threads = std::max(1U, std::thread::hardware_concurrency());
+		}
+		if (threads > 1) {
+			// Only the seekable format says where each frame starts, and how large its content is, without
+			// reading through the whole file
+			std::vector<member> frames = seekTable(_data, _size);
+			if (frames.size() > 1) {
+				_pool.start(std::move(frames), threads, [this](member& piece, size_t limit) {
+					return decompressFrame(_data, piece, limit);
+				});
+			}
+		}
+		return true;
+	}
+
+	size_t zstd_decoder::read(char* buffer, size_t size) {
+		while (true) {
+			if (_current != nullptr) {
+				const size_t count = std::min(size, _current->data.size() - _taken);
+				if (count > 0) {
+					memcpy(buffer, _current->data.data() + _taken, count);
+					_taken += count;
+					return count;
+				}
+
+				_current->data = std::vector<char>();
+				_current = nullptr;
+				_position = _offset;
+			}
+
+			if (_streaming) {
+				ZSTD_inBuffer in = { _data + _offset, _size - _offset, 0 };
+				ZSTD_outBuffer out = { buffer, size, 0 };
+				const size_t status = ZSTD_decompressStream(_stream, &out, &in);
+				_offset += in.pos;
+				_position = _offset;
+
+				if (status == 0) {
+					// The end of a frame
+					_streaming = false;
+				}
+				else if (ZSTD_isError(status) || (in.pos == 0 && out.pos == 0)) {
+					// Corrupt or truncated.  Nothing after it can be read
+					_streaming = false;
+					_offset = _size;
+					failed = true;
+				}
+
+				if (out.pos > 0) {
+					return out.pos;
+				}
+				continue;
+			}
+
+			if (_offset >= _size) {
+				_position = _size;
+				return 0;
+			}
+
+			// Use a worker's result if one started here, otherwise decompress the frame here.  (Skippable
+			// frames, such as the seek table, are streamed and produce nothing.)
+			if ((_current = _pool.take(_offset)) != nullptr) {
+				_taken = 0;
+				_offset = _current->end;
+			}
+			else {
+				ZSTD_DCtx_reset(_stream, ZSTD_reset_session_only);
+				_streaming = true;
+			}
+		}
+	}
+
+	double zstd_decoder::progress() const {
+		return (double)_position / (double)_size;
+	}
+
+	bool ZstdFileDataSource::supported() {
+		return true;
+	}
+
+#else
+
+	// Built without zstd
+	struct zstd_decoder {
+		bool open(const char*, unsigned int) { return false; }
+		size_t read(char*, size_t) { return 0; }
+		double progress() const { return 1.0; }
+		bool failed = false;
+	};
+
+	bool ZstdFileDataSource::supported() {
+		return false;
+	}
+
+#endif
+};
+};
+
+// MARK: - Direct file reads
+
+namespace csv {
+namespace utf8 {
+
+	/// Reads a file with O_DIRECT.  Direct reads must be into an aligned buffer, at an aligned offset and of an
+	/// aligned length, which the parser's buffer isn't, so whole blocks are read into an aligned buffer and
+	/// copied out from there.
+	struct direct_reader {
+		// A multiple of the logical block size of any device
+		static constexpr size_t _ALIGNMENT = 4096;
+
+		bool active = false;
+
+		// Set if a read failed
+		bool failed = false;
+
+		/// Switch 'fd' (open at the start of the file) to direct reads of about 'size' bytes at a time.
+		/// Returns false if the filesystem doesn't support them
+		bool open(int fd, size_t size) {
+#ifdef O_DIRECT
+			const int flags = ::fcntl(fd, F_GETFL);
+			if (flags < 0 || ::fcntl(fd, F_SETFL, flags | O_DIRECT) != 0) {
+				return false;
+			}
+
+			_fd = fd;
+			_size = ((std::max(size, _ALIGNMENT) + _ALIGNMENT - 1) / _ALIGNMENT) * _ALIGNMENT;
+			_storage.resize(_size + _ALIGNMENT);
+			_block = _storage.data() + (_ALIGNMENT - ((uintptr_t)_storage.data() % _ALIGNMENT)) % _ALIGNMENT;
+			active = true;
+			return true;
+#else
+			return false;
+#endif
+		}
+
+		size_t read(char* buffer, size_t size) {
+			if (_start == _end) {
+				if (_ended) {
+					return 0;
+				}
+
+				_start = 0;
+				_end = readBlock();
+
+				// Only the last block is short.  The file offset is no longer aligned after it, so don't
+				// read again
+				_ended = (_end < _size);
+			}
+
+			const size_t count = std::min(size, _end - _start);
+			memcpy(buffer, _block + _start, count);
+			_start += count;
+			return count;
+		}
+
+		/// Carry on reading from 'offset'.  Reads must start at an aligned offset, so the block it is in is
+		/// read and the part before it skipped
+		bool seek(size_t offset) {
+			const size_t aligned = active ? (offset - (offset % _ALIGNMENT)) : offset;
+			if (::lseek(_fd, (off_t)aligned, SEEK_SET) != (off_t)aligned) {
+				return false;
+			}
+
+			_start = _end = 0;
+			_ended = false;
+			if (aligned < offset) {
+				_end = readBlock();
+				_ended = (_end < _size);
+				_start = std::min(offset - aligned, _end);
+			}
+			return true;
+		}
+
+	private:
+		size_t readBlock() {
+			while (true) {
+				const ssize_t count = ::read(_fd, _block, _size);
+				if (count >= 0) {
+					return (size_t)count;
+				}
+				if (errno == EINVAL && active) {
+#ifdef O_DIRECT
+					// Refused after all (eg. the device needs a larger alignment).  Read normally from here
+					::fcntl(_fd, F_SETFL, ::fcntl(_fd, F_GETFL) & ~O_DIRECT);
+#endif
+					active = false;
+					continue;
+				}
+				if (errno != EINTR) {
+					// A read error ends the input
+					failed = true;
+					return 0;
+				}
+			}
+		}
+
+		int _fd = -1;
+		std::vector<char> _storage;
+		char* _block = nullptr;
+		size_t _size = 0;
+		size_t _start = 0;
+		size_t _end = 0;
+		bool _ended = false;
+	};
+};
+};
+
+// MARK: - UTF8 file source
+
+namespace csv {
+namespace utf8 {
+
+	FileDataSource::FileDataSource() noexcept {}
+
+	FileDataSource::~FileDataSource() {
+		close();
+	}
+
+	void FileDataSource::close() {
+		reset();
+		_gzip.reset();
+		_direct.reset();
+		if (_fd >= 0) {
+			::close(_fd);
+			_fd = -1;
+		}
+	}
+
+	bool FileDataSource::open(const char* file) {
+
+		// If we have one open, close it first
+		close();
+
+		// Read the file directly (we do our own, much larger, buffering), so that the kernel can be told how
+		// it is being read
+		_fd = ::open(file, O_RDONLY);
+		if (_fd < 0) {
+			return false;
+		}
+
+		if (decompress) {
+			char magic[2] = {};
+			if (::pread(_fd, magic, 2, 0) == 2 && magic[0] == '\x1f' && magic[1] == '\x8b') {
+				_gzip = std::make_unique<gzip_decoder>();
+				if (_gzip->open(file, threads)) {
+					::close(_fd);
+					_fd = -1;
+					start(-1);
+					return true;
+				}
+
+				// Not gzip after all (or no zlib), so read it as it is
+				_gzip.reset();
+			}
+		}
+
+		// Get the size
+		struct stat info;
+		if (::fstat(_fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+			start(-1);
+			return true;
+		}
+
+		if (directIO) {
+			_direct = std::make_unique<direct_reader>();
+			if (!_direct->open(_fd, bufferSize)) {
+				// Not supported, so use ordinary reads
+				_direct.reset();
+			}
+		}
+
+		// Direct reads don't go through the page cache, so there's nothing to give the kernel hints about
+		start(info.st_size, _direct ? -1 : _fd, 0);
+		return true;
+	}
+
+	bool FileDataSource::direct() const {
+		return _direct != nullptr && _direct->active;
+	}
+
+	double FileDataSource::progress() {
+		const double complete = BufferedDataSource::progress();
+		if (_gzip == nullptr || complete == 1.0) {
+			return complete;
+		}
+		return _gzip->progress();
+	}
+
+	bool FileDataSource::reposition(size_t offset) {
+		if (_gzip) {
+			// Can only be decompressed from the start
+			return false;
+		}
+		if (_direct) {
+			return _direct->seek(offset);
+		}
+		return ::lseek(_fd, (off_t)offset, SEEK_SET) == (off_t)offset;
+	}
+
+	int FileDataSource::descriptor() const {
+		return (_gzip || _direct) ? -1 : _fd;
+	}
+
+	size_t FileDataSource::read(char* buffer, size_t size) {
+		if (_gzip) {
+			const size_t count = _gzip->read(buffer, size);
+			_failed = _gzip->failed;
+			return count;
+		}
+		if (_direct) {
+			const size_t count = _direct->read(buffer, size);
+			_failed = _direct->failed;
+			return count;
+		}
+
+		while (true) {
+			const ssize_t count = ::read(_fd, buffer, size);
+			if (count >= 0) {
+				return (size_t)count;
+			}
+			if (errno != EINTR) {
+				// A read error ends the input
+				_failed = true;
+				return 0;
+			}
+		}
+	}
+};
+
+// MARK: - UTF8 file descriptor source
+
+namespace utf8 {
+
+	FdDataSource::~FdDataSource() {
+		close();
+	}
+
+	void FdDataSource::close() {
+		reset();
+		if (_fd >= 0 && _owned) {
+			::close(_fd);
+		}
+		_fd = -1;
+		_owned = false;
+	}
+
+	bool FdDataSource::open(const char* file) {
+		close();
+
+		const int fd = ::open(file, O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		return open(fd, true);
+	}
+
+	bool FdDataSource::open(int fd, bool owned) {
+		if (fd != _fd) {
+			close();
+		}
+		if (fd < 0) {
+			return false;
+		}
+
+		_fd = fd;
+		_owned = owned;
+
+		// The size is only meaningful for a regular file.  Read from the current position, which may not be
+		// the start (eg. stdin redirected from a partly read file)
+		struct stat info;
+		if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+			const off_t offset = ::lseek(fd, 0, SEEK_CUR);
+			if (offset >= 0 && offset <= info.st_size) {
+				start((long long)(info.st_size - offset), fd, (size_t)offset);
+				return true;
+			}
+		}
+
+		start(-1);
+		return true;
+	}
+
+	bool FdDataSource::reposition(size_t offset) {
+		return ::lseek(_fd, (off_t)offset, SEEK_SET) == (off_t)offset;
+	}
+
+	int FdDataSource::descriptor() const {
+		return _fd;
+	}
+
+	size_t FdDataSource::read(char* buffer, size_t size) {
+		while (true) {
+			const ssize_t count = ::read(_fd, buffer, size);
+			if (count >= 0) {
+				return (size_t)count;
+			}
+			if (errno != EINTR) {
+				// A read error ends the input
+				_failed = true;
+				return 0;
+			}
+		}
+	}
+};
+
+// MARK: - UTF8 file range source
+
+namespace utf8 {
+
+	namespace {
+		/// True if 'c' can't be next to a quote that starts or ends a field
+		bool ordinary(char c, char separator) {
+			return c != separator && c != '\"' && c != '\r' && c != '\n' && c != ' ' && c != '\0';
+		}
+	};
+
+	RangeFileDataSource::~RangeFileDataSource() {
+		close();
+	}
+
+	void RangeFileDataSource::close() {
+		reset();
+		if (_fd >= 0) {
+			::close(_fd);
+			_fd = -1;
+		}
+		_begin = _end = _offset = 0;
+	}
+
+	bool RangeFileDataSource::open(const char* file, size_t begin, size_t end) {
+		close();
+
+		_fd = ::open(file, O_RDONLY);
+		if (_fd < 0) {
+			return false;
+		}
+
+		struct stat info;
+		if (::fstat(_fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+			close();
+			return false;
+		}
+
+		const size_t size = (size_t)info.st_size;
+		end = std::max(begin, end);
+		if (aligned) {
+			_begin = std::min(begin, size);
+			_end = std::min(end, size);
+		}
+		else {
+			_begin = recordStart(begin, size);
+			_end = std::max(_begin, recordStart(end, size));
+		}
+		_offset = _begin;
+
+		start((long long)(_end - _begin), _fd, _begin, false);
+		return true;
+	}
+
+	size_t RangeFileDataSource::recordStart(size_t offset, size_t size) const {
+		if (offset == 0 || offset >= size) {
+			return std::min(offset, size);
+		}
+
+		// A record starts at 'offset' if the character before it is a line ending, so start from there
+		const size_t from = offset - 1;
+
+		// Look for a quote that shows whether 'from' is inside a quoted field.  window[0] is the character
+		// before 'from', and the character after the last one read is '\0' if the window ends before the file
+		// does
+		std::vector<char> window(std::min(lookahead, size - from) + 2, '\0');
+		if (from == 0 || readAt(&window[0], 1, from - 1) != 1) {
+			window[0] = '\n';
+		}
+		const size_t length = readAt(&window[1], window.size() - 2, from);
+		if (from + length >= size) {
+			window[length + 1] = '\n';
+		}
+
+		bool inquote = false;
+		size_t quotes = 0;
+		for (size_t i = 1; i <= length; i++) {
+			if (window[i] != '\"') {
+				continue;
+			}
+			if (ordinary(window[i + 1], separator)) {
+				// Opens a field, so isn't in quotes
+				inquote = (quotes & 1) != 0;
+				break;
+			}
+			if (ordinary(window[i - 1], separator)) {
+				// Closes a field, so is in quotes
+				inquote = (quotes & 1) == 0;
+				break;
+			}
+			quotes++;
+		}
+
+		// Find the first line ending outside quotes
+		for (size_t position = from; position < size; ) {
+			const size_t count = readAt(window.data(), window.size(), position);
+			if (count == 0) {
+				break;
+			}
+
+			for (size_t i = 0; i < count; i++) {
+				const char c = window[i];
+				if (c == '\"') {
+					inquote = !inquote;
+				}
+				else if (!inquote && (c == '\r' || c == '\n')) {
+					// A CR LF pair is a single line ending
+					char following = '\0';
+					if (c == '\r' && i + 1 < count) {
+						following = window[i + 1];
+					}
+					else if (c == '\r') {
+						readAt(&following, 1, position + i + 1);
+					}
+					return position + i + ((following == '\n') ? 2 : 1);
+				}
+			}
+			position += count;
+		}
+		return size;
+	}
+
+	size_t RangeFileDataSource::readAt(char* buffer, size_t size, size_t offset) const {
+		while (true) {
+			const ssize_t count = ::pread(_fd, buffer, size, (off_t)offset);
+			if (count >= 0) {
+				return (size_t)count;
+			}
+			if (errno != EINTR) {
+				return 0;
+			}
+		}
+	}
+
+	bool RangeFileDataSource::reposition(size_t offset) {
+		if (offset < _begin || offset > _end) {
+			return false;
+		}
+		_offset = offset;
+		return true;
+	}
+
+	size_t RangeFileDataSource::read(char* buffer, size_t size) {
+		const size_t count = readAt(buffer, std::min(size, _end - _offset), _offset);
+		_offset += count;
+		if (count == 0 && size > 0 && _offset < _end) {
+			// A read error, or the file has been truncated
+			_failed = true;
+		}
+		return count;
+	}
+};
+
+// MARK: - UTF8 io_uring file source
+
+#ifdef CSV_HAVE_IO_URING
+
+namespace utf8 {
+
+	/// A minimal io_uring, used directly through the system calls.  Each slot has a block buffer, and holds
+	/// (at most) one read.  Blocks are handed out in file order.
+	struct UringFileDataSource::queue {
+		~queue() {
+			// The kernel may still be writing into the buffers
+			if (sqes != nullptr) {
+				for (size_t index = 0; index < slots.size(); index++) {
+					wait(index);
+				}
+			}
+
+			if (sqes != nullptr) {
+				::munmap(sqes, sqesSize);
+			}
+			if (cqRing != nullptr && cqRing != sqRing) {
+				::munmap(cqRing, cqRingSize);
+			}
+			if (sqRing != nullptr) {
+				::munmap(sqRing, sqRingSize);
+			}
+			if (ring >= 0) {
+				::close(ring);
+			}
+		}
+
+		// Set if a read failed
+		bool failed = false;
+
+		/// Start reading 'file' (of 'length' bytes) from 'offset'
+		bool setup(int file, size_t length, size_t offset, size_t blockSize, unsigned int depth) {
+			fd = file;
+			fileSize = length;
+			nextOffset = offset;
 
-	bool DataSource::is_eol() {
-		if (_current == '\r') {
-			if (next() == false) {
-				// Hit the end of file.  Return true and let the caller handle it
+			io_uring_params params;
+			memset(&params, 0, sizeof(params));
+			ring = (int)::syscall(__NR_io_uring_setup, depth, &params);
+			if (ring < 0) {
+				return false;
+			}
+
+			sqRingSize = params.sq_off.array + (params.sq_entries * sizeof(unsigned int));
+			cqRingSize = params.cq_off.cqes + (params.cq_entries * sizeof(io_uring_cqe));
+			const bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+			if (single) {
+				sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+			}
+
+			sqRing = ::mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+			if (sqRing == MAP_FAILED) {
+				sqRing = nullptr;
+				return false;
+			}
+			if (single) {
+				cqRing = sqRing;
+			}
+			else {
+				cqRing = ::mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+				if (cqRing == MAP_FAILED) {
+					cqRing = nullptr;
+					return false;
+				}
+			}
+
+			sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+			void* mapped = ::mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+			if (mapped == MAP_FAILED) {
+				return false;
+			}
+			sqes = (io_uring_sqe*)mapped;
+
+			char* sq = (char*)sqRing;
+			sqTail = (unsigned int*)(sq + params.sq_off.tail);
+			sqMask = *(unsigned int*)(sq + params.sq_off.ring_mask);
+			sqArray = (unsigned int*)(sq + params.sq_off.array);
+
+			char* cq = (char*)cqRing;
+			cqHead = (unsigned int*)(cq + params.cq_off.head);
+			cqTail = (unsigned int*)(cq + params.cq_off.tail);
+			cqMask = *(unsigned int*)(cq + params.cq_off.ring_mask);
+			cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+			slots.resize(std::min(depth, params.sq_entries));
+			for (auto& entry: slots) {
+				entry.buffer.resize(blockSize);
+			}
+
+			// Start reading ahead
+			for (size_t index = 0; index < slots.size(); index++) {
+				if (!submit(index)) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		/// Copy up to 'size' bytes of the next block into 'buffer'
+		size_t read(char* buffer, size_t size) {
+			slot& current = slots[next];
+			if (current.offset == (size_t)-1) {
+				// End of file
+				return 0;
+			}
+
+			if (current.pending && !wait(next)) {
+				failed = true;
+				return 0;
+			}
+
+			if (!current.complete) {
+				if (current.result < 0 || (size_t)current.result < current.length) {
+					// Failed (or never submitted) or short read.  Read the rest of the block directly
+					const size_t have = (current.result < 0) ? 0 : (size_t)current.result;
+					current.length = have + blockingRead(current.buffer.data() + have, current.length - have, current.offset + have);
+				}
+				current.used = 0;
+				current.complete = true;
+			}
+
+			const size_t count = std::min(size, current.length - current.used);
+			memcpy(buffer, current.buffer.data() + current.used, count);
+			current.used += count;
+
+			if (current.used == current.length) {
+				// Finished with this block.  Reuse the slot to read further ahead
+				if (count == 0 || !submit(next)) {
+					current.offset = (size_t)-1;
+				}
+				next = (next + 1) % slots.size();
+			}
+			return count;
+		}
+
+	private:
+		struct slot {
+			std::vector<char> buffer;
+			size_t offset = (size_t)-1;
+			size_t length = 0;
+			size_t used = 0;
+			bool pending = false;
+			// The result of the read has been checked, and the block is ready to copy out
+			bool complete = false;
+			long long result = 0;
+		};
+
+		/// Queue a read of the next block of the file into slot 'index'
+		bool submit(size_t index) {
+			slot& target = slots[index];
+			if (nextOffset >= fileSize) {
+				target.offset = (size_t)-1;
 				return true;
 			}
 
-			if (_current != '\n') {
-				back();
+			target.offset = nextOffset;
+			target.length = std::min(target.buffer.size(), fileSize - nextOffset);
+			target.used = 0;
+			target.pending = true;
+			target.complete = false;
+			nextOffset += target.length;
+
+			const unsigned int tail = *sqTail;
+			const unsigned int position = tail & sqMask;
+			io_uring_sqe* sqe = &sqes[position];
+			memset(sqe, 0, sizeof(*sqe));
+			sqe->opcode = IORING_OP_READ;
+			sqe->fd = fd;
+			sqe->addr = (unsigned long long)target.buffer.data();
+			sqe->len = (unsigned int)target.length;
+			sqe->off = target.offset;
+			sqe->user_data = index;
+			sqArray[position] = position;
+			__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+			while (true) {
+				const int submitted = (int)::syscall(__NR_io_uring_enter, ring, 1, 0, 0, NULL, 0);
+				if (submitted >= 0) {
+					return true;
+				}
+				if (errno != EINTR) {
+					// The kernel didn't take the entry.  Withdraw it, so that it isn't submitted later into a
+					// buffer that has been reused, and leave the block to be read directly
+					__atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+					target.pending = false;
+					target.result = -errno;
+					return true;
+				}
+			}
+		}
+
+		/// Wait for the read into slot 'index' to complete
+		bool wait(size_t index) {
+			while (slots[index].pending) {
+				const unsigned int head = *cqHead;
+				if (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+					const io_uring_cqe& cqe = cqes[head & cqMask];
+					slot& done = slots[cqe.user_data];
+					done.result = cqe.res;
+					done.pending = false;
+					__atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+					continue;
+				}
+
+				const int result = (int)::syscall(__NR_io_uring_enter, ring, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+				if (result < 0 && errno != EINTR) {
+					return false;
+				}
 			}
 			return true;
 		}
-		else if (_current == '\n') {
+
+		size_t blockingRead(char* buffer, size_t size, size_t offset) {
+			size_t total = 0;
+			while (total < size) {
+				const ssize_t count = ::pread(fd, buffer + total, size - total, (off_t)(offset + total));
+				if (count < 0 && errno == EINTR) {
+					continue;
+				}
+				if (count <= 0) {
+					failed = failed || (count < 0);
+					break;
+				}
+				total += (size_t)count;
+			}
+			return total;
+		}
+
+		int fd = -1;
+		size_t fileSize = 0;
+		size_t nextOffset = 0;
+		size_t next = 0;
+		std::vector<slot> slots;
+
+		int ring = -1;
+		void* sqRing = nullptr;
+		size_t sqRingSize = 0;
+		void* cqRing = nullptr;
+		size_t cqRingSize = 0;
+		io_uring_sqe* sqes = nullptr;
+		size_t sqesSize = 0;
+
+		unsigned int* sqTail = nullptr;
+		unsigned int sqMask = 0;
+		unsigned int* sqArray = nullptr;
+		unsigned int* cqHead = nullptr;
+		unsigned int* cqTail = nullptr;
+		unsigned int cqMask = 0;
+		io_uring_cqe* cqes = nullptr;
+	};
+};
+
+#else
+
+namespace utf8 {
+
+	// Built without io_uring support.  Always use blocking reads
+	struct UringFileDataSource::queue {
+		bool setup(int, size_t, size_t, size_t, unsigned int) { return false; }
+		size_t read(char*, size_t) { return 0; }
+		bool failed = false;
+	};
+};
+
+#endif
+
+namespace utf8 {
+
+	UringFileDataSource::UringFileDataSource() noexcept {}
+
+	UringFileDataSource::~UringFileDataSource() {
+		close();
+	}
+
+	void UringFileDataSource::close() {
+		reset();
+		_queue.reset();
+		if (_fd >= 0) {
+			::close(_fd);
+			_fd = -1;
+		}
+	}
+
+	bool UringFileDataSource::open(const char* file) {
+		close();
+
+		_fd = ::open(file, O_RDONLY);
+		if (_fd < 0) {
+			return false;
+		}
+
+		long long length = -1;
+		struct stat info;
+		if (::fstat(_fd, &info) == 0 && S_ISREG(info.st_mode)) {
+			length = info.st_size;
+
+			// The queue only reads as far as the size of the file, so a file being followed uses blocking reads
+			if (!follow) {
+				_queue = std::make_unique<queue>();
+				if (!_queue->setup(_fd, (size_t)length, 0, std::max(bufferSize, _BOMS_SIZE), std::max(1U, queueDepth))) {
+					// Use blocking reads instead
+					_queue.reset();
+				}
+			}
+			start(length, _fd, 0);
 			return true;
 		}
-		return false;
+
+		start(length);
+		return true;
+	}
+
+	bool UringFileDataSource::asynchronous() const {
+		return _queue != nullptr;
+	}
+
+	bool UringFileDataSource::reposition(size_t offset) {
+		if (::lseek(_fd, (off_t)offset, SEEK_SET) != (off_t)offset) {
+			return false;
+		}
+		if (_queue) {
+			// Abandon the reads in flight, and start again from 'offset'
+			struct stat info;
+			_queue = std::make_unique<queue>();
+			if (::fstat(_fd, &info) != 0 ||
+				!_queue->setup(_fd, (size_t)info.st_size, offset, std::max(bufferSize, _BOMS_SIZE), std::max(1U, queueDepth))) {
+				// Use blocking reads instead
+				_queue.reset();
+			}
+		}
+		return true;
+	}
+
+	int UringFileDataSource::descriptor() const {
+		return _queue ? -1 : _fd;
+	}
+
+	size_t UringFileDataSource::read(char* buffer, size_t size) {
+		if (_queue) {
+			const size_t count = _queue->read(buffer, size);
+			_failed = _queue->failed;
+			return count;
+		}
+
+		while (true) {
+			const ssize_t count = ::read(_fd, buffer, size);
+			if (count >= 0) {
+				return (size_t)count;
+			}
+			if (errno != EINTR) {
+				_failed = true;
+				return 0;
+			}
+		}
 	}
 };
+
+// MARK: - UTF8 gzip file source
+
+namespace utf8 {
+
+	GzipFileDataSource::GzipFileDataSource() noexcept {}
+
+	GzipFileDataSource::~GzipFileDataSource() {
+		close();
+	}
+
+	void GzipFileDataSource::close() {
+		reset();
+		_decoder.reset();
+	}
+
+	bool GzipFileDataSource::open(const char* file) {
+		close();
+
+		_decoder = std::make_unique<gzip_decoder>();
+		if (!_decoder->open(file, threads)) {
+			_decoder.reset();
+			return false;
+		}
+
+		// The size of the content isn't known until it has been decompressed
+		start(-1);
+		return true;
+	}
+
+	double GzipFileDataSource::progress() {
+		const double complete = BufferedDataSource::progress();
+		if (_decoder == nullptr || complete == 1.0) {
+			return complete;
+		}
+		return _decoder->progress();
+	}
+
+	size_t GzipFileDataSource::read(char* buffer, size_t size) {
+		if (_decoder == nullptr) {
+			return 0;
+		}
+		const size_t count = _decoder->read(buffer, size);
+		_failed = _decoder->failed;
+		return count;
+	}
 };
 
-// MARK: - UTF8 file source
+// MARK: - UTF8 zstd file source
 
-namespace csv {
 namespace utf8 {
 
-	FileDataSource::~FileDataSource() {
+	ZstdFileDataSource::ZstdFileDataSource() noexcept {}
+
+	ZstdFileDataSource::~ZstdFileDataSource() {
 		close();
 	}
 
-	void FileDataSource::close() {
-		if (_in.is_open()) {
-			_in.close();
+	void ZstdFileDataSource::close() {
+		reset();
+		_decoder.reset();
+	}
+
+	bool ZstdFileDataSource::open(const char* file) {
+		close();
+
+		_decoder = std::make_unique<zstd_decoder>();
+		if (!_decoder->open(file, threads)) {
+			_decoder.reset();
+			return false;
+		}
+
+		// The size of the content isn't known until it has been decompressed
+		start(-1);
+		return true;
+	}
+
+	double ZstdFileDataSource::progress() {
+		const double complete = BufferedDataSource::progress();
+		if (_decoder == nullptr || complete == 1.0) {
+			return complete;
 		}
+		return _decoder->progress();
 	}
 
-	bool FileDataSource::open(const char* file) {
+	size_t ZstdFileDataSource::read(char* buffer, size_t size) {
+		if (_decoder == nullptr) {
+			return 0;
+		}
+		const size_t count = _decoder->read(buffer, size);
+		_failed = _decoder->failed;
+		return count;
+	}
+};
+
+// MARK: - UTF8 memory mapped file source
+
+namespace utf8 {
+
+	MappedFileDataSource::~MappedFileDataSource() {
+		close();
+	}
+
+	void MappedFileDataSource::close() {
+		if (_data != nullptr) {
+			::munmap((void*)_data, _length);
+			_data = nullptr;
+		}
+		if (_fd >= 0) {
+			::close(_fd);
+			_fd = -1;
+		}
+		_length = 0;
+		_offset = -1;
+		_mark = 0;
+		_dropped = 0;
+		_prev = 0;
+	}
+
+	bool MappedFileDataSource::open(const char* file) {
 
 		// If we have one open, close it first
 		close();
 
-		_in.open(file, std::ios::in | std::ios::binary);
-		if (_in.is_open()) {
+		int fd = ::open(file, O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+
+		struct stat info;
+		if (::fstat(fd, &info) != 0) {
+			::close(fd);
+			return false;
+		}
+
+		_length = (size_t)info.st_size;
+		if (_length == 0) {
+			// Nothing to map (mmap refuses zero-length mappings).  An empty file is still a valid source
+			::close(fd);
+			return true;
+		}
 
-			// Get the size
-			_in.ignore( std::numeric_limits<std::streamsize>::max() );
-			_length = _in.gcount();
-			_in.clear();   //  Since ignore will have set eof.
-			_in.seekg( 0, std::ios_base::beg );
+		void* mapped = ::mmap(NULL, _length, PROT_READ, MAP_PRIVATE, fd, 0);
 
-			if (_length < (int)_BOMS_SIZE) {
-				// If we have less chars in the file than the size of the BOM.
-				return true;
-			}
+		// The mapping holds its own reference to the file.  The descriptor is only kept to drop pages from
+		// the page cache
+		if (dropConsumed && mapped != MAP_FAILED) {
+			_fd = fd;
+		}
+		else {
+			::close(fd);
+		}
+
+		if (mapped == MAP_FAILED) {
+			_length = 0;
+			return false;
+		}
+		_data = (const char*)mapped;
+
+		::madvise(mapped, _length, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+		if (hugePages && _length >= 2 * 1024 * 1024) {
+			::madvise(mapped, _length, MADV_HUGEPAGE);
+		}
+#endif
+
+		if (_length >= _BOMS_SIZE && memcmp(_data, _BOMS.c_str(), _BOMS_SIZE) == 0) {
+			// We have a BOM. Set the starting offset to AFTER it
+			// (note that the offset starts at -1, so we need to set offset to 3 - 1)
+			_offset = _BOMS_SIZE - 1;
+		}
+
+		// Give the first hints on the first read
+		_mark = 0;
+		return true;
+	}
+
+	bool MappedFileDataSource::advance() {
+		if (_offset == (size_t)-1) {
+			// Nothing has been read yet (eg. consume(0) before the first fill())
+			return true;
+		}
+
+		const bool ended = (_offset >= _length);
+		const size_t page = (size_t)::sysconf(_SC_PAGESIZE);
+		const size_t from = ended ? _length : (_offset - (_offset % page));
 
-			// Check if we have a BOM - Read the first three bytes.
-			std::array<char, _BOMS_SIZE> utf8BOM;
-			std::fill(utf8BOM.begin(), utf8BOM.end(), 0);
-			_in.read(utf8BOM.data(), utf8BOM.size());
+		if (!ended) {
+			// Ask for the file to be read in ahead of the parser
+			::madvise((void*)(_data + from), std::min(_HINT_WINDOW, _length - from), MADV_WILLNEED);
+			_mark = std::min(_offset + _HINT_WINDOW / 2, _length);
+		}
 
-			if (memcmp(_BOMS.c_str(), utf8BOM.data(), _BOMS_SIZE) != 0) {
-				_in.clear();					// clear fail and eof bits
-				_in.seekg(0, std::ios::beg);	// back to the start!
+		if (_fd >= 0) {
+			// Drop what was parsed before the previous hints.  Records handed out since then may still be in
+			// use (although they would only be read back in if they were)
+			const size_t behind = ended ? _length : ((from > _HINT_WINDOW) ? from - _HINT_WINDOW : 0);
+			if (behind > _dropped) {
+				::madvise((void*)(_data + _dropped), behind - _dropped, MADV_DONTNEED);
+#ifdef POSIX_FADV_DONTNEED
+				::posix_fadvise(_fd, (off_t)_dropped, (off_t)(behind - _dropped), POSIX_FADV_DONTNEED);
+#endif
+				_dropped = behind;
 			}
 		}
 
-		return _in.is_open();
+		return !ended;
 	}
 
-	double FileDataSource::progress() {
-		double pos = _in.tellg();
-		double len = _length;
-		[[unlikely]]
-		if(pos < 0){
-			// pos can be -1, since tellg can return that at the end!
+	bool MappedFileDataSource::seek(size_t offset) {
+		if (offset > _length) {
+			return false;
+		}
+
+		// The offset is that of the current character, so one before the next to be read
+		_offset = offset - 1;
+		_mark = 0;
+		_prev = 0;
+		return true;
+	}
+
+	double MappedFileDataSource::progress() {
+		if (_length == 0) {
 			return 1.0;
 		}
+		double pos = _offset;
+		double len = _length;
 		return std::min(pos / len, 1.0);
 	}
 
-	bool FileDataSource::next() {
-		if (_in.peek() == EOF) {
+	bool MappedFileDataSource::fill(const char*& data, size_t& size) {
+		const size_t start = _offset + 1;
+		if (start >= _length) {
+			// Leave the offset where a failed next() would
+			_offset = _length;
+			advance();
 			return false;
 		}
 
-		_prev = _current;
-		_in.get(_current);
+		data = _data + start;
+		size = _length - start;
 		return true;
 	}
-
-	void FileDataSource::back() {
-		_current = _prev;
-		_prev = 0;
-		_in.unget();
-	}
 };
 
 // MARK: - UTF8 string source
@@ -161,27 +2204,32 @@ namespace utf8 {
 		return true;
 	}
 
+	bool StringDataSource::seek(size_t offset) {
+		if (offset > _in.size()) {
+			return false;
+		}
+		_offset = offset - 1;
+		_prev = 0;
+		return true;
+	}
+
 	double StringDataSource::progress() {
 		double pos = _offset;
 		double len = _in.length();
 		return std::min(pos / len, 1.0);
 	}
 
-	bool StringDataSource::next() {
-		_offset++;
-		if (_offset >= _in.size()) {
+	bool StringDataSource::fill(const char*& data, size_t& size) {
+		const size_t start = _offset + 1;
+		if (start >= _in.size()) {
+			// Leave the offset where a failed next() would
+			_offset = _in.size();
 			return false;
 		}
 
-		_prev = _current;
-		_current = _in[_offset];
+		data = _in.data() + start;
+		size = _in.size() - start;
 		return true;
 	}
-
-	void StringDataSource::back() {
-		_current = _prev;
-		_prev = 0;
-		_offset--;
-	}
 };
 };
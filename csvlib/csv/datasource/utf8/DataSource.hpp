@@ -27,9 +27,14 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <csv/datasource/IDataSource.hpp>
 
@@ -43,7 +48,7 @@ public:
   char separator = ',';
   char comment = '\0';
 
-protected:
+public:
   // Character detection
 
   inline virtual bool is_separator() const { return _current == separator; }
@@ -57,9 +62,49 @@ protected:
 
   inline virtual void clear_field() { _field.clear(); }
   inline virtual std::string field() const { return _field; }
+  inline virtual void append_field(std::string &out) const {
+    out.append(_field);
+  }
   inline virtual void push() { _field += _current; }
 
-  virtual bool is_eol();
+  inline virtual bool is_eol() {
+    if (_current == '\r') {
+      if (next() == false) {
+        // Hit the end of file.  Return true and let the caller handle it
+        return true;
+      }
+
+      if (_current != '\n') {
+        back();
+      }
+      return true;
+    }
+    return _current == '\n';
+  }
+
+  // Bulk access (used by csv::structural::parse)
+
+  /// Point 'data' at the unread bytes following the current character, reading
+  /// more from the underlying storage if needed.  Returns false at the end of
+  /// the data.  'data' is valid until the next call to fill() or next()
+  virtual bool fill(const char *&data, size_t &size) = 0;
+
+  /// Mark the first 'count' bytes returned by fill() as read
+  virtual void consume(size_t count) = 0;
+
+  /// The number of bytes of the input read so far, which is the offset in the
+  /// input of the data the next call to fill() returns
+  virtual size_t consumed() const = 0;
+
+  /// Carry on from 'offset' in the input (the start of a record, eg. from a
+  /// csv::checkpoint) rather than from the start, without looking for a BOM
+  /// there.  Call once the source is open, before parsing.  Returns false if
+  /// the input can't be seeked (eg. a pipe or a compressed file)
+  virtual bool seek(size_t) { return false; }
+
+  /// True if the input ended early because it couldn't be read (a read error,
+  /// or a corrupt or truncated compressed file) rather than at its end
+  virtual bool failed() const { return false; }
 
 protected:
   char _prev = 0;
@@ -69,13 +114,204 @@ private:
   std::string _field;
 };
 
-class FileDataSource : public utf8::DataSource {
+// Inflates a gzip file (shared by FileDataSource and GzipFileDataSource)
+struct gzip_decoder;
+
+// Decompresses a zstd file (used by ZstdFileDataSource)
+struct zstd_decoder;
+
+// Reads a file with O_DIRECT (used by FileDataSource)
+struct direct_reader;
+
+/// A data source that reads its input in large blocks into an internal buffer,
+/// rather than pulling single characters from a stream.  Subclasses supply the
+/// blocks.
+class BufferedDataSource : public utf8::DataSource {
+public:
+  /// The size (in bytes) of each block read.  Takes effect on the next call to
+  /// open().  Values between 64KiB and 4MiB work well.
+  size_t bufferSize = 256 * 1024;
+
+  /// Read the input on a background thread, so that reading overlaps with
+  /// parsing.  The thread stays up to 'prefetchBuffers' blocks ahead of the
+  /// parser.  Takes effect on the next call to open().  Closing the source
+  /// waits for any read in progress to finish
+  bool prefetch = false;
+  size_t prefetchBuffers = 4;
+
+  /// Drop the parts of the file that have been parsed from the page cache, so
+  /// that a single pass over a large file doesn't push everything else out of
+  /// it.  Parts that were cached before parsing started are dropped as well.
+  /// Takes effect on the next call to open()
+  bool dropConsumed = false;
+
+  /// Keep reading as the file grows, like 'tail -f'.  At the end of the file,
+  /// wait for more to be appended (watching the file with inotify on Linux,
+  /// otherwise checking every 'followInterval' milliseconds) rather than
+  /// ending the input.  Each record is delivered once its line ending has been
+  /// read, so a final record that is still being written is held until it is
+  /// complete.  Following stops if the file is truncated, or within
+  /// 'followInterval' of the source being cancelled (which can be done from
+  /// another thread).  Only for a regular file read to its end (so not for a
+  /// range, a compressed file, or with directIO).  Both take effect on the
+  /// next call to open()
+  bool follow = false;
+  unsigned int followInterval = 100;
+
+public:
+  BufferedDataSource() noexcept = default;
+  virtual ~BufferedDataSource();
+
+  inline virtual bool next() {
+    if (_position + 1 >= _end && !refill()) {
+      return false;
+    }
+
+    _prev = _current;
+    _current = _buffer[++_position];
+    return true;
+  }
+
+  inline virtual void back() {
+    _current = _prev;
+    _prev = 0;
+    _position--;
+  }
+
+  /// The fraction of the input read.  If the size of the input is unknown (eg.
+  /// a pipe), 0.0 until the end of the input is reached
+  virtual double progress();
+
+  virtual bool fill(const char *&data, size_t &size);
+  inline virtual void consume(size_t count) { _position += count; }
+  inline virtual size_t consumed() const { return _base + _position; }
+
+  virtual bool seek(size_t offset);
+
+  inline virtual bool failed() const { return _failed; }
+
+  /// Stops the prefetch thread, so that it doesn't carry on waiting for a
+  /// followed file to grow.  The blocks it has read are kept for the next
+  /// parse, which reads without prefetch
+  virtual void parse_ended();
+
+protected:
+  /// Read up to 'size' bytes into 'buffer'.  Returns the number of bytes read,
+  /// or 0 at the end of the input (setting _failed as well if it ends because
+  /// it can't be read)
+  virtual size_t read(char *buffer, size_t size) = 0;
+
+  /// Make read() carry on from 'offset' in the file (or in the input, if it
+  /// isn't read from a file).  Returns false if that isn't possible
+  virtual bool reposition(size_t) { return false; }
+
+  /// The descriptor read() reads from directly, if any, so that the prefetch
+  /// thread can wait for a pipe or socket without blocking in read()
+  virtual int descriptor() const { return -1; }
+
+  /// Start reading the input, skipping any BOM.  'length' is the size of the
+  /// input in bytes, or -1 if it isn't known.  If the input is read from a
+  /// file, 'fd' is its descriptor and 'offset' where the input starts in it, so
+  /// that the kernel can be told how the file is being read.  'toEnd' if the
+  /// input runs to the end of the file (and so can be followed)
+  void start(long long length, int fd = -1, size_t offset = 0,
+             bool toEnd = true);
+
+  /// Discard the buffered input, stopping the prefetch thread.  Subclasses
+  /// must call this before releasing anything read() uses
+  void reset();
+
+  bool _failed = false;
+
+private:
+  bool refill();
+  void skipBOM();
+  size_t readBlock();
+  void hint();
+
+  size_t input(char *buffer, size_t size);
+  void watch();
+  bool waitForInput();
+
+  void startPrefetch();
+  void prefetchInput();
+  bool readable();
+  void joinPrefetch();
+  void stopPrefetch();
+
+  long long _length = -1;
+  bool _exhausted = false;
+  bool _checkBOM = false;
+
+  // _buffer[0] holds the last character of the previous block so that back()
+  // can step across a block boundary.  Input starts at _buffer[1].
+  std::vector<char> _buffer;
+  size_t _position = 0;
+  size_t _end = 0;
+  size_t _base = 0;
+
+  // The file the input is read from, where the input starts in it, the input
+  // position at which to give the kernel the next hints, and the end of the
+  // part of the file dropped from the page cache
+  int _file = -1;
+  size_t _fileOffset = 0;
+  size_t _hinted = 0;
+  size_t _dropped = 0;
+  bool _drop = false;
+
+  // Following the file, how often to check it for changes (copied from
+  // followInterval, as the prefetch thread reads it), and the inotify
+  // descriptor watching it (if any)
+  bool _following = false;
+  unsigned int _followInterval = 100;
+  int _watch = -1;
+
+  // The prefetch ring.  The thread fills block (produced % size) while fewer
+  // than size blocks are waiting, and the parser swaps block (taken % size)
+  // with _buffer, handing its old buffer back for the thread to reuse.  A
+  // block with no content marks the end of the input.  Blocks filled before
+  // the thread is stopped by parse_ended() are still taken afterwards
+  struct block {
+    std::vector<char> buffer;
+    size_t count = 0;
+  };
+  std::vector<block> _ring;
+  std::atomic<size_t> _produced{0};
+  std::atomic<size_t> _taken{0};
+  std::atomic<bool> _stopping{false};
+  std::thread _reader;
+
+  // When reading from a pipe or socket, its descriptor and a pipe used to wake
+  // the prefetch thread while it waits for input
+  int _stream = -1;
+  int _wake[2] = {-1, -1};
+};
+
+/// A file data source that reads the file in large blocks into an internal
+/// buffer, rather than pulling single characters from the stream.
+class FileDataSource final : public utf8::BufferedDataSource {
 public:
-  FileDataSource() noexcept {}
+  FileDataSource() noexcept;
   ~FileDataSource();
 
+  /// Decompress the file if it is gzip compressed (see GzipFileDataSource).
+  /// Takes effect on the next call to open()
+  bool decompress = true;
+
+  /// The number of threads used to decompress a gzip file with several
+  /// members (0 to use one per core).  One by default, as several sources are
+  /// often read at once (eg. by csv::parse_files).  Takes effect on the next
+  /// call to open()
+  unsigned int threads = 1;
+
+  /// Read the file with O_DIRECT, bypassing the page cache, for files that
+  /// are read once and won't be needed again.  Falls back to ordinary reads if
+  /// the filesystem doesn't support it.  Not used for gzip compressed files.
+  /// Takes effect on the next call to open()
+  bool directIO = false;
+
   /// Throws csv::file_exception if unable to open file
-  FileDataSource(const char *file) {
+  FileDataSource(const char *file) : FileDataSource() {
     if (!open(file)) {
       throw csv::file_exception();
     }
@@ -83,22 +319,381 @@ public:
 
   FileDataSource(const std::string &file) : FileDataSource{file.c_str()} {}
 
+  FileDataSource(const FileDataSource &) = delete;
+  FileDataSource &operator=(const FileDataSource &) = delete;
+
   inline bool open(const std::string &file) { return open(file.c_str()); }
 
   bool open(const char *file);
   void close();
 
+  virtual double progress();
+
+  /// True if the file is being read with O_DIRECT
+  bool direct() const;
+
+protected:
+  virtual size_t read(char *buffer, size_t size);
+  virtual bool reposition(size_t offset);
+  virtual int descriptor() const;
+
+private:
+  int _fd = -1;
+  std::unique_ptr<gzip_decoder> _gzip;
+  std::unique_ptr<direct_reader> _direct;
+};
+
+/// A data source that reads from a file descriptor -- including stdin, pipes
+/// and FIFOs, which cannot be measured or seeked.
+class FdDataSource final : public utf8::BufferedDataSource {
+public:
+  FdDataSource() noexcept {}
+  ~FdDataSource();
+
+  /// Throws csv::file_exception if unable to open file
+  FdDataSource(const char *file) {
+    if (!open(file)) {
+      throw csv::file_exception();
+    }
+  }
+
+  FdDataSource(const std::string &file) : FdDataSource{file.c_str()} {}
+
+  FdDataSource(const FdDataSource &) = delete;
+  FdDataSource &operator=(const FdDataSource &) = delete;
+
+  inline bool open(const std::string &file) { return open(file.c_str()); }
+
+  /// Open a file.  The descriptor is closed by close()
+  bool open(const char *file);
+
+  /// Read from an existing descriptor (eg. STDIN_FILENO).  If 'owned' the
+  /// descriptor is closed by close()
+  bool open(int fd, bool owned = false);
+
+  void close();
+
+protected:
+  virtual size_t read(char *buffer, size_t size);
+  virtual bool reposition(size_t offset);
+  virtual int descriptor() const;
+
+private:
+  int _fd = -1;
+  bool _owned = false;
+};
+
+/// A data source that reads only the records of a file that start within the
+/// byte range [begin, end), so that one file can be split between several
+/// processes or machines, none of which read all of it.
+///
+/// Reading starts at the first record that starts at or after 'begin', and
+/// finishes with the record that straddles 'end'.  Splitting a file into
+/// adjacent ranges gives each record to exactly one of them.
+///
+/// Whether 'begin' falls inside a quoted field isn't known without reading
+/// the file from the start, so it is deduced from the quotes that follow it:
+/// a quote followed by an ordinary character must open a field, and one
+/// preceded by an ordinary character must close one.  With no evidence within
+/// 'lookahead' bytes, 'begin' is assumed not to be in quotes.  If the range is
+/// known to start and end at record boundaries (eg. from an index), set
+/// 'aligned' to use it as it is.
+///
+/// The separator must be set before opening.  Row numbers start at 0 for the
+/// first record in the range.
+class RangeFileDataSource final : public utf8::BufferedDataSource {
+public:
+  RangeFileDataSource() noexcept {}
+  ~RangeFileDataSource();
+
+  /// Throws csv::file_exception if unable to open file
+  RangeFileDataSource(const char *file, size_t begin, size_t end) {
+    if (!open(file, begin, end)) {
+      throw csv::file_exception();
+    }
+  }
+
+  RangeFileDataSource(const std::string &file, size_t begin, size_t end)
+      : RangeFileDataSource{file.c_str(), begin, end} {}
+
+  RangeFileDataSource(const RangeFileDataSource &) = delete;
+  RangeFileDataSource &operator=(const RangeFileDataSource &) = delete;
+
+  /// 'begin' and 'end' are record boundaries, so use them as they are.  Takes
+  /// effect on the next call to open()
+  bool aligned = false;
+
+  /// How far past a range boundary to look for quotes that show whether it is
+  /// inside a quoted field.  Takes effect on the next call to open()
+  size_t lookahead = 1024 * 1024;
+
+  inline bool open(const std::string &file, size_t begin, size_t end) {
+    return open(file.c_str(), begin, end);
+  }
+
+  bool open(const char *file, size_t begin, size_t end);
+  void close();
+
+  /// The part of the file being read, once open: from the start of the first
+  /// record in the range to the end of the last
+  inline size_t begin() const { return _begin; }
+  inline size_t end() const { return _end; }
+
+protected:
+  virtual size_t read(char *buffer, size_t size);
+  virtual bool reposition(size_t offset);
+
+private:
+  size_t recordStart(size_t offset, size_t size) const;
+  size_t readAt(char *buffer, size_t size, size_t offset) const;
+
+  int _fd = -1;
+  size_t _begin = 0;
+  size_t _end = 0;
+  size_t _offset = 0;
+};
+
+/// A file data source that keeps several reads of the file in flight at once
+/// using io_uring (Linux), so that reading the next blocks overlaps with
+/// parsing the current one.
+///
+/// Falls back to blocking reads if io_uring isn't available (not built in, not
+/// supported by the kernel, or not permitted), or the file is not a regular
+/// file.
+class UringFileDataSource final : public utf8::BufferedDataSource {
 public:
-  virtual bool next();
-  virtual void back();
+  UringFileDataSource() noexcept;
+  ~UringFileDataSource();
+
+  /// The number of blocks to read ahead.  Takes effect on the next call to
+  /// open()
+  unsigned int queueDepth = 4;
+
+  /// Throws csv::file_exception if unable to open file
+  UringFileDataSource(const char *file) : UringFileDataSource() {
+    if (!open(file)) {
+      throw csv::file_exception();
+    }
+  }
+
+  UringFileDataSource(const std::string &file)
+      : UringFileDataSource{file.c_str()} {}
+
+  UringFileDataSource(const UringFileDataSource &) = delete;
+  UringFileDataSource &operator=(const UringFileDataSource &) = delete;
+
+  inline bool open(const std::string &file) { return open(file.c_str()); }
+
+  bool open(const char *file);
+  void close();
+
+  /// True if the file is being read using io_uring, false if using blocking
+  /// reads
+  bool asynchronous() const;
+
+protected:
+  virtual size_t read(char *buffer, size_t size);
+  virtual bool reposition(size_t offset);
+  virtual int descriptor() const;
+
+private:
+  struct queue;
+
+  int _fd = -1;
+  std::unique_ptr<queue> _queue;
+};
+
+/// A data source that decompresses a gzip file as it is read, inflating
+/// directly into the parser's buffer.
+///
+/// Files made up of several gzip members (eg. concatenated .gz files, or BGZF
+/// files from bgzip) have their members decompressed in parallel on worker
+/// threads, a few members ahead of the parser (holding at most 256MiB of
+/// decompressed content between them).  The members of a BGZF file are
+/// found from their headers; otherwise members are found by searching for
+/// gzip headers and checked as they are reached, so a false match only costs
+/// some wasted work.  Requires zlib.
+///
+/// Progress is the fraction of the compressed file decompressed.
+class GzipFileDataSource final : public utf8::BufferedDataSource {
+public:
+  GzipFileDataSource() noexcept;
+  ~GzipFileDataSource();
+
+  /// The number of threads used to decompress a file with several members (0
+  /// to use one per core).  Takes effect on the next call to open()
+  unsigned int threads = 0;
+
+  /// Throws csv::file_exception if unable to open the file, or it isn't gzip
+  /// compressed
+  GzipFileDataSource(const char *file) : GzipFileDataSource() {
+    if (!open(file)) {
+      throw csv::file_exception();
+    }
+  }
+
+  GzipFileDataSource(const std::string &file)
+      : GzipFileDataSource{file.c_str()} {}
+
+  GzipFileDataSource(const GzipFileDataSource &) = delete;
+  GzipFileDataSource &operator=(const GzipFileDataSource &) = delete;
+
+  inline bool open(const std::string &file) { return open(file.c_str()); }
+
+  /// Returns false if the file cannot be opened, or isn't gzip compressed
+  bool open(const char *file);
+  void close();
+
   virtual double progress();
 
+  /// True if gzip support is available (ie. the library was built with zlib)
+  static bool supported();
+
+protected:
+  virtual size_t read(char *buffer, size_t size);
+
 private:
-  std::ifstream _in;
-  std::streamsize _length;
+  std::unique_ptr<gzip_decoder> _decoder;
 };
 
-class StringDataSource : public utf8::DataSource {
+/// A data source that decompresses a zstd file as it is read, streaming each
+/// frame directly into the parser's buffer.
+///
+/// Files in the zstd seekable format (a series of independent frames followed
+/// by a table of their sizes) have their frames decompressed in parallel on
+/// worker threads, a few frames ahead of the parser (holding at most 256MiB of
+/// decompressed content between them).  Requires libzstd.
+///
+/// Progress is the fraction of the compressed file decompressed.
+class ZstdFileDataSource final : public utf8::BufferedDataSource {
+public:
+  ZstdFileDataSource() noexcept;
+  ~ZstdFileDataSource();
+
+  /// The number of threads used to decompress a seekable file (0 to use one
+  /// per core).  Takes effect on the next call to open()
+  unsigned int threads = 0;
+
+  /// Throws csv::file_exception if unable to open the file, or it isn't zstd
+  /// compressed
+  ZstdFileDataSource(const char *file) : ZstdFileDataSource() {
+    if (!open(file)) {
+      throw csv::file_exception();
+    }
+  }
+
+  ZstdFileDataSource(const std::string &file)
+      : ZstdFileDataSource{file.c_str()} {}
+
+  ZstdFileDataSource(const ZstdFileDataSource &) = delete;
+  ZstdFileDataSource &operator=(const ZstdFileDataSource &) = delete;
+
+  inline bool open(const std::string &file) { return open(file.c_str()); }
+
+  /// Returns false if the file cannot be opened, or isn't zstd compressed
+  bool open(const char *file);
+  void close();
+
+  virtual double progress();
+
+  /// True if zstd support is available (ie. the library was built with
+  /// libzstd)
+  static bool supported();
+
+protected:
+  virtual size_t read(char *buffer, size_t size);
+
+private:
+  std::unique_ptr<zstd_decoder> _decoder;
+};
+
+/// A file data source that maps the entire file into memory and walks it
+/// directly, avoiding per-character stream overhead for large files.
+///
+/// The kernel is told that the mapping is read sequentially, and asked to read
+/// the file ahead of the parser.
+class MappedFileDataSource final : public utf8::DataSource {
+public:
+  MappedFileDataSource() noexcept {}
+  ~MappedFileDataSource();
+
+  /// Unmap the parts of the file that have been parsed and drop them from the
+  /// page cache, so that a single pass over a large file doesn't push
+  /// everything else out of it.  Takes effect on the next call to open()
+  bool dropConsumed = false;
+
+  /// Ask for large files to be mapped using transparent huge pages, which
+  /// reduces TLB misses.  Only has an effect on Linux, if the kernel supports
+  /// huge pages for files.  Takes effect on the next call to open()
+  bool hugePages = false;
+
+  /// Throws csv::file_exception if unable to open or map the file
+  MappedFileDataSource(const char *file) {
+    if (!open(file)) {
+      throw csv::file_exception();
+    }
+  }
+
+  MappedFileDataSource(const std::string &file)
+      : MappedFileDataSource{file.c_str()} {}
+
+  MappedFileDataSource(const MappedFileDataSource &) = delete;
+  MappedFileDataSource &operator=(const MappedFileDataSource &) = delete;
+
+  inline bool open(const std::string &file) { return open(file.c_str()); }
+
+  bool open(const char *file);
+  void close();
+
+public:
+  inline virtual bool next() {
+    _offset++;
+    if (_offset >= _mark && !advance()) {
+      return false;
+    }
+
+    _prev = _current;
+    _current = _data[_offset];
+    return true;
+  }
+
+  inline virtual void back() {
+    _current = _prev;
+    _prev = 0;
+    _offset--;
+  }
+
+  virtual double progress();
+
+  virtual bool fill(const char *&data, size_t &size);
+  inline virtual void consume(size_t count) {
+    _offset += count;
+    if (_offset >= _mark) {
+      advance();
+    }
+  }
+  inline virtual size_t consumed() const {
+    return std::min(_offset + 1, _length);
+  }
+
+  virtual bool seek(size_t offset);
+
+private:
+  bool advance();
+
+  const char *_data = nullptr;
+  size_t _length = 0;
+  size_t _offset = -1;
+
+  // The offset at which to give the kernel the next hints (never past the
+  // end), the end of the part of the mapping dropped, and the file descriptor
+  // used to drop it from the page cache
+  size_t _mark = 0;
+  size_t _dropped = 0;
+  int _fd = -1;
+};
+
+class StringDataSource final : public utf8::DataSource {
 public:
   StringDataSource() noexcept : _offset(-1) {}
   StringDataSource(const std::string &data) {
@@ -109,10 +704,33 @@ public:
   bool set(const std::string &data);
 
 public:
-  virtual bool next();
-  virtual void back();
+  inline virtual bool next() {
+    _offset++;
+    if (_offset >= _in.size()) {
+      return false;
+    }
+
+    _prev = _current;
+    _current = _in[_offset];
+    return true;
+  }
+
+  inline virtual void back() {
+    _current = _prev;
+    _prev = 0;
+    _offset--;
+  }
+
   virtual double progress();
 
+  virtual bool fill(const char *&data, size_t &size);
+  inline virtual void consume(size_t count) { _offset += count; }
+  inline virtual size_t consumed() const {
+    return std::min(_offset + 1, _in.size());
+  }
+
+  virtual bool seek(size_t offset);
+
 private:
   size_t _offset;
   std::string _in;
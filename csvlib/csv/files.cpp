@@ -0,0 +1,205 @@
+//
+//  files.cpp
+//
+//  MIT license
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+//  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all copies or substantial
+//  portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+//  WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+//  OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+//  OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "files.hpp"
+
+#include <csv/datasource/utf8/DataSource.hpp>
+
+#include <glob.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+#include <thread>
+
+namespace {
+
+	/// The sizes of the files, or false if any of them doesn't exist (or is a directory)
+	bool fileSizes(const std::vector<std::string>& paths, std::vector<size_t>& sizes) {
+		sizes.clear();
+		for (const auto& path: paths) {
+			struct stat info;
+			if (::stat(path.c_str(), &info) != 0 || S_ISDIR(info.st_mode)) {
+				return false;
+			}
+			sizes.push_back((size_t)info.st_size);
+		}
+		return true;
+	}
+
+	/// Open 'path' with the settings in 'options'
+	bool openFile(csv::utf8::FileDataSource& source, const std::string& path, const csv::structural::dialect& options) {
+		source.separator = options.separator;
+		source.comment = options.comment;
+		source.trimLeadingWhitespace = options.trimLeadingWhitespace;
+		source.skipBlankLines = options.skipBlankLines;
+		return source.open(path);
+	}
+};
+
+namespace csv {
+
+	std::vector<std::string> glob(const std::string& pattern) {
+		std::vector<std::string> paths;
+
+		glob_t found;
+		if (::glob(pattern.c_str(), 0, NULL, &found) == 0) {
+			for (size_t i = 0; i < found.gl_pathc; i++) {
+				paths.emplace_back(found.gl_pathv[i]);
+			}
+		}
+		::globfree(&found);
+		return paths;
+	}
+
+	State parse_files(const std::vector<std::string>& paths,
+					  size_t threads,
+					  FileRecordViewCallback emitRecord,
+					  const structural::dialect& options) {
+
+		std::vector<size_t> sizes;
+		if (!fileSizes(paths, sizes)) {
+			return State::Error;
+		}
+
+		if (threads == 0) {
+			threads = std::max(1U, std::thread::hardware_concurrency());
+		}
+
+		// Largest first.  Each thread takes the next file as soon as it is free
+		std::vector<size_t> order(paths.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+		std::atomic<size_t> next(0);
+		std::atomic<bool> stopped(false);
+		std::atomic<bool> failed(false);
+
+		const auto parse = [&]() {
+			utf8::FileDataSource source;
+			for (size_t index = next++; index < order.size() && !stopped; index = next++) {
+				const size_t file = order[index];
+				if (!openFile(source, paths[file], options)) {
+					failed = true;
+					stopped = true;
+					return;
+				}
+
+				const State state = structural::parse(source, [&](const csv::record_view& record, double progress) -> bool {
+					if (stopped) {
+						return false;
+					}
+					if (emitRecord && emitRecord(file, record, progress) == false) {
+						stopped = true;
+						return false;
+					}
+					return true;
+				});
+				if (state == State::Error) {
+					failed = true;
+					stopped = true;
+					return;
+				}
+			}
+		};
+
+		std::vector<std::thread> workers;
+		for (size_t i = 1; i < std::min(threads, paths.size()); i++) {
+			workers.emplace_back(parse);
+		}
+		parse();
+		for (auto& worker: workers) {
+			worker.join();
+		}
+
+		return failed ? State::Error : State::Complete;
+	}
+
+	State parse_concatenated(const std::vector<std::string>& paths,
+							 FileRecordViewCallback emitRecord,
+							 const structural::dialect& options,
+							 bool dedupeHeader) {
+
+		std::vector<size_t> sizes;
+		if (!fileSizes(paths, sizes)) {
+			return State::Error;
+		}
+		const double total = (double)std::accumulate(sizes.begin(), sizes.end(), (size_t)0);
+
+		// The first record of the first file with any records, to compare with the first record of each later
+		// file
+		std::vector<std::string> header;
+		bool haveHeader = false;
+
+		// The records are renumbered, so their fields are too
+		std::vector<csv::field_view> fields;
+		size_t rows = 0;
+		size_t done = 0;
+
+		utf8::FileDataSource source;
+		for (size_t file = 0; file < paths.size(); file++) {
+			if (!openFile(source, paths[file], options)) {
+				return State::Error;
+			}
+
+			bool first = true;
+			bool stopped = false;
+			const State state = structural::parse(source, [&](const csv::record_view& record, double progress) -> bool {
+				if (first) {
+					first = false;
+					if (!haveHeader) {
+						haveHeader = true;
+						for (const auto& field: record) {
+							header.emplace_back(field.content);
+						}
+					}
+					else if (dedupeHeader && record.size() == header.size() &&
+							 std::equal(record.begin(), record.end(), header.begin(),
+										[](const csv::field_view& field, const std::string& name) { return field.content == name; })) {
+						return true;
+					}
+				}
+
+				fields.assign(record.begin(), record.end());
+				for (auto& field: fields) {
+					field.row = rows;
+				}
+				const csv::record_view renumbered(fields.data(), fields.size(), rows++);
+
+				const double complete = (total > 0) ? ((double)done + (progress * (double)sizes[file])) / total : 1.0;
+				if (emitRecord && emitRecord(file, renumbered, std::min(complete, 1.0)) == false) {
+					stopped = true;
+					return false;
+				}
+				return true;
+			});
+
+			if (state == State::Error) {
+				return State::Error;
+			}
+			if (stopped) {
+				break;
+			}
+			done += sizes[file];
+		}
+
+		return State::Complete;
+	}
+};
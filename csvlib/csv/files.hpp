@@ -0,0 +1,77 @@
+//
+//  files.hpp
+//
+//  MIT license
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+//  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all copies or substantial
+//  portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+//  WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+//  OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+//  OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#pragma once
+
+#include <csv/parser.hpp>
+#include <csv/structural.hpp>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Parsing a set of UTF-8 files (eg. daily partitions of a table).
+//
+// Each file is read using a csv::utf8::FileDataSource, so gzip compressed files are decompressed as they are
+// read.
+
+namespace csv {
+
+	/// Called for each record of a set of files, with the index of the record's file in the list.  Returns
+	/// false to stop parsing.
+	typedef std::function<bool(size_t file, const csv::record_view& record, double progress)> FileRecordViewCallback;
+
+	/// The files matching a shell wildcard pattern (eg. "exports/2024-*.csv"), in sorted order
+	std::vector<std::string> glob(const std::string& pattern);
+
+	/// Parse several UTF-8 files concurrently using 'threads' threads (0 to use one per core).
+	///
+	/// Each file is parsed by a single thread, and each thread takes another file as soon as it finishes one,
+	/// largest first, so that a few large files don't leave the other threads idle at the end.  (The files are
+	/// handed out from one shared list rather than by work stealing between per-thread queues.  A file is the
+	/// smallest piece of work, so there is nothing smaller to steal, and taking the largest file left is what
+	/// balances the threads.)  The records of each file are delivered in order with the file's own row numbers,
+	/// and 'progress' is the progress through that file.  The callback is called concurrently from the worker
+	/// threads (never concurrently for the same file), and the record is only valid for the duration of the
+	/// callback.
+	///
+	/// Returns csv::State::Error if any of the files doesn't exist (found before anything is parsed), or can't
+	/// be opened or read to its end (eg. a truncated gzip file).  Those are found when a thread reaches the
+	/// file, after which the other threads stop at their next record.  The records of a file read before an
+	/// error are still delivered.
+	csv::State parse_files(const std::vector<std::string>& paths,
+						   size_t threads,
+						   csv::FileRecordViewCallback emitRecord,
+						   const structural::dialect& options = structural::dialect());
+
+	/// Parse several UTF-8 files one after another on the calling thread, as if they were a single file.
+	///
+	/// Row numbers carry on from one file to the next.  The header is the first record of the first file that
+	/// has any records.  If 'dedupeHeader' is set, the first record of each later file is dropped if it
+	/// matches the header (ie. a repeated header line).  'progress' is the fraction of the total size of the
+	/// files parsed.
+	///
+	/// Returns csv::State::Error if any of the files doesn't exist (found before anything is parsed), or can't
+	/// be opened or read to its end (eg. a truncated gzip file).  Those are found when the file is reached,
+	/// after the files before it (and the records of it read before the error) have been delivered.
+	csv::State parse_concatenated(const std::vector<std::string>& paths,
+								  csv::FileRecordViewCallback emitRecord,
+								  const structural::dialect& options = structural::dialect(),
+								  bool dedupeHeader = true);
+};
@@ -0,0 +1,392 @@
+//
+//  index.cpp
+//
+//  MIT license
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+//  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all copies or substantial
+//  portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+//  WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+//  OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+//  OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "index.hpp"
+#include "bytes.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+namespace {
+
+	using csv::bytes::put;
+	using csv::bytes::get;
+
+	// The sidecar file starts with the magic bytes and the format version.  All numbers are little endian
+	const char _MAGIC[] = { 'C', 'S', 'V', 'I', 'D', 'X', '\0', '\2' };
+	const size_t _MAGIC_SIZE = sizeof(_MAGIC);
+
+	// The size of each read when looking for a record from an indexed one
+	const size_t _READ_SIZE = 256 * 1024;
+
+	// The size of the block at the end of the indexed part of a file that is checked before updating the index
+	const size_t _CHECK_SIZE = 4096;
+
+	/// The size and modification time of a file
+	bool fileStatus(const std::string& path, size_t& size, int64_t& modified) {
+		std::error_code error;
+		size = (size_t)std::filesystem::file_size(path, error);
+		if (error) {
+			return false;
+		}
+		const auto time = std::filesystem::last_write_time(path, error);
+		if (error) {
+			return false;
+		}
+		modified = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+		return true;
+	}
+
+	/// A hash (FNV-1a) of the block of the file before 'end'
+	bool blockHash(const std::string& path, size_t end, uint64_t& hash) {
+		const int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+
+		const size_t begin = end - std::min(end, _CHECK_SIZE);
+		std::vector<char> block(end - begin);
+		const bool complete = (::pread(fd, block.data(), block.size(), (off_t)begin) == (ssize_t)block.size());
+		::close(fd);
+
+		hash = 0xcbf29ce484222325ULL;
+		for (const char c: block) {
+			hash = (hash ^ (uint8_t)c) * 0x100000001b3ULL;
+		}
+		return complete;
+	}
+
+	/// The offset of the end of the record just returned by 'tokens', given the next byte of the input.  A
+	/// line feed following a carriage return belongs to the record
+	size_t recordEnd(const csv::structural::tokenizer& tokens, size_t base, char following) {
+		const size_t end = base + tokens.position();
+		return tokens.between_records(following) ? end : end + 1;
+	}
+
+	/// The offset of the record following the 'count' records starting at 'offset'
+	size_t skipRecords(int fd, size_t size, size_t offset, size_t count, const csv::structural::dialect& options) {
+		csv::structural::tokenizer tokens(options);
+		std::vector<char> buffer(_READ_SIZE);
+
+		for (size_t base = offset; base < size; ) {
+			const ssize_t length = ::pread(fd, buffer.data(), std::min(buffer.size(), size - base), (off_t)base);
+			if (length <= 0) {
+				break;
+			}
+
+			tokens.feed(buffer.data(), (size_t)length);
+			while (tokens.next()) {
+				if (tokens.rows() < count) {
+					continue;
+				}
+
+				char following = '\0';
+				if (tokens.position() < (size_t)length) {
+					following = buffer[tokens.position()];
+				}
+				else if (::pread(fd, &following, 1, (off_t)(base + length)) != 1) {
+					following = '\0';
+				}
+				return recordEnd(tokens, base, following);
+			}
+			base += (size_t)length;
+		}
+		return size;
+	}
+
+	/// Index the records from index.tail onwards, given the content of the file from there
+	void scan(csv::index::row_index& index, const char* data, size_t size) {
+		const size_t base = index.tail;
+		const size_t before = index.tailRows;
+
+		// Keep the entries for the records before the tail, which includes one at the tail itself if it falls
+		// on the interval
+		index.offsets.resize(std::min(index.offsets.size(), (before + index.interval - 1) / index.interval));
+		if (before % index.interval == 0) {
+			index.offsets.push_back(base);
+		}
+		index.rows = before;
+
+		csv::structural::tokenizer tokens(index.options);
+		tokens.feed(data, size);
+		for (bool finished = false; ; finished = true) {
+			while (tokens.next()) {
+				const size_t rows = before + tokens.rows();
+				const size_t position = tokens.position();
+				const size_t end = recordEnd(tokens, base, (position < size) ? data[position] : '\0');
+
+				// A record ended by the end of the input, or by a carriage return at the very end (which could
+				// be followed by a line feed), could carry on if more is appended
+				if (!finished && (position < size || data[size - 1] != '\r')) {
+					index.tail = end;
+					index.tailRows = rows;
+				}
+
+				if (rows == index.rows) {
+					// A skipped blank line
+					continue;
+				}
+
+				index.rows = rows;
+				if (rows % index.interval == 0) {
+					index.offsets.push_back(end);
+				}
+			}
+			if (finished) {
+				break;
+			}
+			tokens.finish();
+		}
+
+		// The entry following the last record (if it fell on the interval) isn't the start of one
+		while (index.offsets.size() > 1 && (index.offsets.size() - 1) * index.interval >= index.rows) {
+			index.offsets.pop_back();
+		}
+	}
+
+	/// Read the sidecar file of 'path', whether or not it is up to date
+	bool readSidecar(const std::string& path, csv::index::row_index& index) {
+		std::ifstream file(csv::index::sidecar(path), std::ios::binary);
+		if (!file.is_open()) {
+			return false;
+		}
+		const std::string in((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+		if (in.size() < _MAGIC_SIZE + 8 || !std::equal(_MAGIC, _MAGIC + _MAGIC_SIZE, in.begin())) {
+			return false;
+		}
+
+		csv::index::row_index loaded;
+		loaded.options.separator = in[_MAGIC_SIZE];
+		loaded.options.comment = in[_MAGIC_SIZE + 1];
+		loaded.options.trimLeadingWhitespace = (in[_MAGIC_SIZE + 2] != 0);
+		loaded.options.skipBlankLines = (in[_MAGIC_SIZE + 3] != 0);
+
+		size_t position = _MAGIC_SIZE + 8;
+		uint64_t interval, size, modified, rows, tail, tailRows, checksum, count;
+		if (!get(in, position, interval) || !get(in, position, size) || !get(in, position, modified) ||
+			!get(in, position, rows) || !get(in, position, tail) || !get(in, position, tailRows) ||
+			!get(in, position, checksum) || !get(in, position, count) ||
+			interval == 0 || count == 0 || count > (in.size() - position) / 8) {
+			return false;
+		}
+
+		loaded.interval = (size_t)interval;
+		loaded.size = (size_t)size;
+		loaded.modified = (int64_t)modified;
+		loaded.rows = (size_t)rows;
+		loaded.tail = (size_t)tail;
+		loaded.tailRows = (size_t)tailRows;
+		loaded.checksum = checksum;
+		loaded.offsets.resize((size_t)count);
+		for (auto& offset: loaded.offsets) {
+			get(in, position, offset);
+		}
+
+		index = std::move(loaded);
+		return true;
+	}
+};
+
+namespace csv {
+namespace index {
+
+	std::string sidecar(const std::string& path) {
+		return path + ".csvidx";
+	}
+
+	bool build(const std::string& path, row_index& index, const structural::dialect& options, size_t interval) {
+		row_index built;
+		built.options = options;
+		built.interval = std::max<size_t>(interval, 1);
+
+		utf8::MappedFileDataSource source;
+		if (!source.open(path) || !fileStatus(path, built.size, built.modified) ||
+			!blockHash(path, built.size, built.checksum)) {
+			return false;
+		}
+
+		// The whole file, less any BOM
+		const char* data = nullptr;
+		size_t size = 0;
+		if (!source.fill(data, size)) {
+			size = 0;
+		}
+		built.tail = built.size - size;
+		scan(built, data, size);
+
+		index = std::move(built);
+		return true;
+	}
+
+	bool update(const std::string& path, row_index& index) {
+		size_t size = 0;
+		int64_t modified = 0;
+		uint64_t checksum = 0;
+		if (!fileStatus(path, size, modified) || size < index.size ||
+			!blockHash(path, index.size, checksum) || checksum != index.checksum) {
+			return false;
+		}
+
+		if (size == index.size) {
+			// Nothing appended
+			index.modified = modified;
+			return true;
+		}
+		if (index.tail == 0) {
+			// Nothing has been indexed yet (and the file may now start with a BOM)
+			return build(path, index, index.options, index.interval);
+		}
+
+		utf8::MappedFileDataSource source;
+		const char* data = nullptr;
+		size_t length = 0;
+		if (!source.open(path) || !source.fill(data, length) || !blockHash(path, size, checksum)) {
+			return false;
+		}
+
+		// The mapping covers the file less any BOM.  Parse from the tail
+		const size_t base = size - length;
+		if (index.tail < base || index.tail > size) {
+			return false;
+		}
+		index.size = size;
+		index.modified = modified;
+		index.checksum = checksum;
+		scan(index, data + (index.tail - base), size - index.tail);
+		return true;
+	}
+
+	bool update(const std::string& path) {
+		row_index index;
+		if (!readSidecar(path, index)) {
+			return false;
+		}
+		if (!update(path, index) && !build(path, index, index.options, index.interval)) {
+			return false;
+		}
+		return save(path, index);
+	}
+
+	bool build(const std::string& path, const structural::dialect& options, size_t interval) {
+		row_index index;
+		return build(path, index, options, interval) && save(path, index);
+	}
+
+	bool save(const std::string& path, const row_index& index) {
+		std::string out(_MAGIC, _MAGIC_SIZE);
+		out.push_back(index.options.separator);
+		out.push_back(index.options.comment);
+		out.push_back(index.options.trimLeadingWhitespace ? 1 : 0);
+		out.push_back(index.options.skipBlankLines ? 1 : 0);
+		out.append(4, '\0');
+
+		put(out, index.interval);
+		put(out, index.size);
+		put(out, (uint64_t)index.modified);
+		put(out, index.rows);
+		put(out, index.tail);
+		put(out, index.tailRows);
+		put(out, index.checksum);
+		put(out, index.offsets.size());
+		for (const uint64_t offset: index.offsets) {
+			put(out, offset);
+		}
+
+		// Write a temporary file and move it into place, so that a reader never sees a partly written index
+		const std::string name = sidecar(path);
+		const std::string temporary = name + ".tmp";
+		{
+			std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+			if (!file.write(out.data(), (std::streamsize)out.size())) {
+				return false;
+			}
+		}
+
+		std::error_code error;
+		std::filesystem::rename(temporary, name, error);
+		if (error) {
+			std::filesystem::remove(temporary, error);
+			return false;
+		}
+		return true;
+	}
+
+	bool load(const std::string& path, row_index& index) {
+		row_index loaded;
+		if (!readSidecar(path, loaded)) {
+			return false;
+		}
+
+		// Check the index is for the file as it is now
+		size_t size = 0;
+		int64_t modified = 0;
+		if (!fileStatus(path, size, modified) || size != loaded.size || modified != loaded.modified) {
+			return false;
+		}
+
+		index = std::move(loaded);
+		return true;
+	}
+
+	size_t locate(const std::string& path, const row_index& index, size_t row) {
+		if (row >= index.rows || index.offsets.empty()) {
+			return index.size;
+		}
+
+		const size_t entry = std::min(row / index.interval, index.offsets.size() - 1);
+		const size_t offset = (size_t)index.offsets[entry];
+		const size_t count = row - (entry * index.interval);
+		if (count == 0) {
+			return offset;
+		}
+
+		const int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return index.size;
+		}
+		const size_t result = skipRecords(fd, index.size, offset, count, index.options);
+		::close(fd);
+		return result;
+	}
+
+	bool seek(utf8::RangeFileDataSource& source,
+			  const std::string& path,
+			  const row_index& index,
+			  size_t first,
+			  size_t last) {
+
+		const size_t begin = locate(path, index, first);
+		const size_t end = (last < index.rows) ? locate(path, index, std::max(first, last)) : index.size;
+
+		source.separator = index.options.separator;
+		source.comment = index.options.comment;
+		source.trimLeadingWhitespace = index.options.trimLeadingWhitespace;
+		source.skipBlankLines = index.options.skipBlankLines;
+		source.aligned = true;
+		return source.open(path.c_str(), begin, end);
+	}
+};
+};
@@ -0,0 +1,131 @@
+//
+//  index.hpp
+//
+//  MIT license
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+//  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all copies or substantial
+//  portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+//  WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+//  OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+//  OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#pragma once
+
+#include <csv/structural.hpp>
+#include <csv/datasource/utf8/DataSource.hpp>
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// Record indexes for large UTF-8 files, so that a run of records can be read without parsing the file from
+// the start.
+//
+//     csv::index::build("big.csv");
+//     ...
+//     csv::index::row_index index;
+//     csv::utf8::RangeFileDataSource source;
+//     if (csv::index::load("big.csv", index) && csv::index::seek(source, "big.csv", index, 40000000, 40100000)) {
+//         csv::parse(source, ...);
+//     }
+//
+// The index is kept in a sidecar file next to the file ("big.csv.csvidx").  If records are only ever appended
+// to the file (eg. a log), the index can be brought up to date by parsing just the new records:
+//
+//     csv::index::update("big.csv");
+
+namespace csv {
+namespace index {
+
+	/// The number of records between the entries of an index, unless told otherwise.  Finding a record
+	/// parses at most this many records
+	const size_t defaultInterval = 4096;
+
+	/// The start of every 'interval'th record of a file.  Records are counted (and blank lines skipped or
+	/// not) as csv::parse does with the same dialect.
+	///
+	/// Every entry is the start of a record, where the parser is never inside a quoted field, so the offset
+	/// is all that is needed to carry on parsing from there.
+	struct row_index {
+		/// The dialect the file was parsed with
+		structural::dialect options;
+
+		size_t interval = defaultInterval;
+
+		/// The size and modification time (in nanoseconds) of the file when it was indexed
+		size_t size = 0;
+		int64_t modified = 0;
+
+		/// The number of records in the file
+		size_t rows = 0;
+
+		/// offsets[i] is the offset in the file of record (i * interval).  There is always at least one entry,
+		/// for the first record (following any BOM)
+		std::vector<uint64_t> offsets;
+
+		/// The end of the last record that is complete however the file is appended to, and the number of
+		/// records before it.  Anything after it (eg. a final record without a line ending) is parsed again
+		/// when the index is updated
+		size_t tail = 0;
+		size_t tailRows = 0;
+
+		/// A hash of the last block of the file, used to check that it hasn't changed when updating
+		uint64_t checksum = 0;
+	};
+
+	/// The name of the sidecar file holding the index of 'path'
+	std::string sidecar(const std::string& path);
+
+	/// Index the UTF-8 file 'path', recording the start of every 'interval'th record.  Returns false if the
+	/// file can't be read
+	bool build(const std::string& path,
+			   row_index& index,
+			   const structural::dialect& options = structural::dialect(),
+			   size_t interval = defaultInterval);
+
+	/// Index the UTF-8 file 'path', and save the index in its sidecar file.  Returns false if the file can't
+	/// be read, or the sidecar file can't be written
+	bool build(const std::string& path,
+			   const structural::dialect& options = structural::dialect(),
+			   size_t interval = defaultInterval);
+
+	/// Save the index of 'path' in its sidecar file
+	bool save(const std::string& path, const row_index& index);
+
+	/// Load the index of 'path' from its sidecar file.  Returns false if there is no index, or the file has
+	/// changed since it was indexed
+	bool load(const std::string& path, row_index& index);
+
+	/// Bring the index of 'path' up to date after records have been appended to the file, by parsing only
+	/// what was appended.  Returns false, leaving the index as it was, if the file has been changed in some
+	/// other way (it is smaller, or the end of the part indexed is different), or can't be read
+	bool update(const std::string& path, row_index& index);
+
+	/// Bring the index of 'path' in its sidecar file up to date, building it again (with the same dialect
+	/// and interval) if the file has been changed other than by appending records.  Returns false if there is
+	/// no index, the file can't be read, or the sidecar file can't be written
+	bool update(const std::string& path);
+
+	/// The offset in 'path' of the start of record 'row', parsing from the closest indexed record before it.
+	/// The size of the file if there is no such record
+	size_t locate(const std::string& path, const row_index& index, size_t row);
+
+	/// Open 'source' to read records 'first' up to (but not including) 'last' of 'path', or to the end of
+	/// the file if there are fewer records.  The source's row numbers start at 0 for record 'first'.
+	/// Returns false if the file can't be opened
+	bool seek(utf8::RangeFileDataSource& source,
+			  const std::string& path,
+			  const row_index& index,
+			  size_t first,
+			  size_t last = (size_t)-1);
+};
+};
@@ -0,0 +1,254 @@
+//
+//  parallel.cpp
+//
+//  MIT license
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+//  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all copies or substantial
+//  portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+//  WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+//  OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+//  OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+	/// A piece of the file, and the results of parsing it
+	struct chunk {
+		size_t begin = 0;
+		size_t end = 0;
+
+		bool parsed = false;
+		csv::record_batch records;
+		std::unique_ptr<csv::structural::tokenizer> tokens;
+	};
+
+	/// Run 'work(index)' for each index in [0, count) using up to 'threads' threads
+	template <typename Work>
+	void forEach(size_t count, size_t threads, Work work) {
+		std::atomic<size_t> next(0);
+		const auto run = [&]() {
+			for (size_t index = next++; index < count; index = next++) {
+				work(index);
+			}
+		};
+
+		std::vector<std::thread> workers;
+		for (size_t i = 1; i < std::min(threads, count); i++) {
+			workers.emplace_back(run);
+		}
+		run();
+		for (auto& worker: workers) {
+			worker.join();
+		}
+	}
+
+	/// The position following the first line ending at or after 'from' that is outside quotes, given whether
+	/// 'from' is inside quotes
+	size_t nextBoundary(const char* data, size_t size, size_t from, bool inquote) {
+		for (size_t i = from; i < size; i++) {
+			const char c = data[i];
+			if (c == '\"') {
+				inquote = !inquote;
+			}
+			else if (!inquote && (c == '\r' || c == '\n')) {
+				if (c == '\r' && i + 1 < size && data[i + 1] == '\n') {
+					return i + 2;
+				}
+				return i + 1;
+			}
+		}
+		return size;
+	}
+
+	/// Run the rest of the input fed to 'tokens' through it, collecting the records in 'records'
+	void collect(csv::structural::tokenizer& tokens, bool skipBlankLines, csv::record_batch& records) {
+		while (tokens.next()) {
+			const csv::record_view& view = tokens.record();
+			if (skipBlankLines && view.empty()) {
+				continue;
+			}
+			records.add(view);
+		}
+	}
+};
+
+namespace csv {
+
+	State parse_parallel(const std::string& path,
+						 size_t threads,
+						 RecordViewCallback emitRecord,
+						 const structural::dialect& options,
+						 size_t chunkSize) {
+
+		utf8::MappedFileDataSource source;
+		if (!source.open(path)) {
+			return State::Error;
+		}
+
+		// The whole file, less any BOM
+		const char* data = nullptr;
+		size_t size = 0;
+		if (!source.fill(data, size)) {
+			return State::Complete;
+		}
+
+		if (threads == 0) {
+			threads = std::max(1U, std::thread::hardware_concurrency());
+		}
+		if (chunkSize == 0) {
+			chunkSize = std::clamp<size_t>(size / (threads * 4), 1024 * 1024, 8 * 1024 * 1024);
+		}
+
+		// Pre-pass.  The parity of the number of quotes in each chunk
+		const size_t nominal = (size + chunkSize - 1) / chunkSize;
+		std::vector<uint8_t> parity(nominal);
+		forEach(nominal, threads, [&](size_t index) {
+			const char* start = data + (index * chunkSize);
+			const size_t length = std::min(chunkSize, size - (index * chunkSize));
+			parity[index] = std::count(start, start + length, '\"') & 1;
+		});
+
+		// Guess where each chunk starts
+		std::vector<chunk> chunks(1);
+		bool inquote = false;
+		for (size_t index = 1; index < nominal; index++) {
+			inquote = inquote != (parity[index - 1] != 0);
+			const size_t start = nextBoundary(data, size, index * chunkSize, inquote);
+			if (start > chunks.back().begin && start < size) {
+				chunks.back().end = start;
+				chunks.emplace_back();
+				chunks.back().begin = start;
+			}
+		}
+		chunks.back().end = size;
+
+		// Parse the chunks, staying at most 'window' chunks ahead of the delivery of the results
+		const size_t window = threads * 2;
+		std::mutex lock;
+		std::condition_variable changed;
+		size_t delivered = 0;
+		bool stopped = false;
+
+		std::atomic<size_t> next(0);
+		const auto parse = [&]() {
+			while (true) {
+				const size_t index = next++;
+				if (index >= chunks.size()) {
+					return;
+				}
+
+				{
+					std::unique_lock<std::mutex> guard(lock);
+					changed.wait(guard, [&]() { return stopped || index < delivered + window; });
+					if (stopped) {
+						return;
+					}
+				}
+
+				chunk& piece = chunks[index];
+				auto tokens = std::make_unique<structural::tokenizer>(options);
+				piece.records.reserve(piece.end - piece.begin);
+				tokens->feed(data + piece.begin, piece.end - piece.begin);
+				if (index + 1 == chunks.size()) {
+					tokens->finish();
+				}
+				collect(*tokens, options.skipBlankLines, piece.records);
+
+				std::lock_guard<std::mutex> guard(lock);
+				piece.tokens = std::move(tokens);
+				piece.parsed = true;
+				changed.notify_all();
+			}
+		};
+
+		std::vector<std::thread> workers;
+		for (size_t i = 0; i < std::min(threads, chunks.size()); i++) {
+			workers.emplace_back(parse);
+		}
+
+		const auto stop = [&]() {
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				stopped = true;
+				changed.notify_all();
+			}
+			for (auto& worker: workers) {
+				worker.join();
+			}
+		};
+
+		// Deliver the chunks in order.  'current' is the parser whose records are being delivered, and
+		// 'base' the global row number of its first row.
+		std::unique_ptr<structural::tokenizer> current;
+		size_t base = 0;
+		size_t rows = 0;
+		bool clean = true;
+
+		for (size_t index = 0; index < chunks.size(); index++) {
+			chunk& piece = chunks[index];
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				changed.wait(guard, [&]() { return piece.parsed; });
+			}
+
+			const bool last = (index + 1 == chunks.size());
+			if (clean) {
+				// The previous chunk ended where this one started, so its parse is correct
+				current = std::move(piece.tokens);
+				base = rows;
+			}
+			else {
+				// The guess for where this chunk starts was wrong.  The previous chunk's parser carries on
+				// through it instead
+				piece.records.clear();
+				current->feed(data + piece.begin, piece.end - piece.begin);
+				if (last) {
+					current->finish();
+				}
+				collect(*current, options.skipBlankLines, piece.records);
+			}
+
+			rows = base + current->rows();
+			clean = last || current->between_records(data[piece.end]);
+
+			piece.records.offset_rows(base);
+			piece.records.finish();
+
+			const double progress = (double)piece.end / (double)size;
+			for (const csv::record_view& record: piece.records) {
+				if (emitRecord && emitRecord(record, progress) == false) {
+					stop();
+					return State::Complete;
+				}
+			}
+
+			// Release the chunk's memory and let the workers move on
+			piece.records = csv::record_batch();
+			piece.tokens.reset();
+
+			std::lock_guard<std::mutex> guard(lock);
+			delivered = index + 1;
+			changed.notify_all();
+		}
+
+		stop();
+		return State::Complete;
+	}
+};
@@ -0,0 +1,53 @@
+//
+//  parallel.hpp
+//
+//  MIT license
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+//  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all copies or substantial
+//  portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+//  WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+//  OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+//  OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#pragma once
+
+#include <csv/parser.hpp>
+#include <csv/structural.hpp>
+
+#include <string>
+
+// Parsing a single UTF-8 file on several threads.
+//
+// The file is mapped and split into chunks.  A pre-pass counts the quotes in each chunk (in parallel) so that
+// each chunk can start at the first line ending after its nominal start that is outside quotes.  The chunks
+// are then parsed concurrently, and delivered in order.
+//
+// The quote count is only a guess at where records start (eg. a comment line containing a quote will fool
+// it), so each guess is checked as the chunks are delivered -- a chunk's parse is only used if the previous
+// chunk ended exactly where it started.  Otherwise the previous chunk's parser simply carries on through the
+// chunk on the delivering thread.  Either way, the results are identical to csv::structural::parse.
+
+namespace csv {
+
+	/// Parse a UTF-8 file using 'threads' threads (0 to use one per core).  Records are delivered in order,
+	/// with the same row numbers as csv::parse, on the calling thread.  The record is only valid for the
+	/// duration of the callback.
+	///
+	/// 'chunkSize' is the size of the pieces the file is split into.  0 picks a size based on the size of the
+	/// file and the number of threads.
+	///
+	/// Returns csv::State::Error if the file cannot be opened.
+	csv::State parse_parallel(const std::string& path,
+							  size_t threads,
+							  csv::RecordViewCallback emitRecord,
+							  const structural::dialect& options = structural::dialect(),
+							  size_t chunkSize = 0);
+};
@@ -25,6 +25,7 @@
 #include <csv/datasource/IDataSource.hpp>
 
 #include <functional>
+#include <string_view>
 
 namespace csv {
 
@@ -60,10 +61,666 @@ struct record {
 	}
 };
 
+/// A field that refers to its content rather than owning it.  Only valid within the callback it was passed to
+struct field_view {
+	size_t row = 0;
+	size_t column = 0;
+	std::string_view content;
+};
+
+/// A record whose fields refer to the parser's buffers.  Only valid within the callback it was passed to;
+/// use to_record() to keep a copy
+class record_view {
+public:
+	size_t row = 0;
+
+	record_view() noexcept {}
+	record_view(const field_view* fields, size_t count, size_t number) noexcept
+	: row(number), _fields(fields), _count(count) {}
+
+	inline size_t size() const { return _count; }
+	inline const field_view& operator[](const size_t offset) const { return _fields[offset]; }
+
+	inline const field_view* begin() const { return _fields; }
+	inline const field_view* end() const { return _fields + _count; }
+
+	inline bool empty() const {
+		for (const auto& field: *this) {
+			if (field.content.length() > 0) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/// Copy into a record that owns its content
+	inline csv::record to_record() const {
+		csv::record result;
+		result.row = row;
+		result.content.resize(_count);
+		for (size_t i = 0; i < _count; i++) {
+			result.content[i].row = _fields[i].row;
+			result.content[i].column = _fields[i].column;
+			result.content[i].content.assign(_fields[i].content.data(), _fields[i].content.size());
+		}
+		return result;
+	}
+
+private:
+	const field_view* _fields = nullptr;
+	size_t _count = 0;
+};
+
+/// A record whose field content is stored end to end in a single buffer, with the end offset of each field
+/// alongside.  Clearing the arena keeps the storage, so once it has grown to fit the largest record, reusing
+/// it for the following records doesn't allocate.
+class record_arena {
+public:
+	size_t row = 0;
+
+	inline void clear() {
+		_bytes.clear();
+		_offsets.clear();
+	}
+
+	inline size_t size() const { return _offsets.size(); }
+	inline std::string_view operator[](const size_t offset) const {
+		const size_t start = (offset == 0) ? 0 : _offsets[offset - 1];
+		return std::string_view(_bytes.data() + start, _offsets[offset] - start);
+	}
+
+	/// The buffer to append the content of the current field to
+	inline std::string& bytes() { return _bytes; }
+
+	/// The current field is complete
+	inline void end_field() { _offsets.push_back(_bytes.size()); }
+
+	/// A view of the record.  Valid until the arena is next changed
+	inline csv::record_view view() {
+		_fields.resize(_offsets.size());
+		for (size_t i = 0; i < _offsets.size(); i++) {
+			_fields[i].row = row;
+			_fields[i].column = i;
+			_fields[i].content = (*this)[i];
+		}
+		return csv::record_view(_fields.data(), _fields.size(), row);
+	}
+
+private:
+	std::string _bytes;
+	std::vector<size_t> _offsets;
+	std::vector<field_view> _fields;
+};
+
+/// When to deliver a batch of records.  A batch is delivered as soon as either limit is reached (a limit of
+/// zero is ignored), and at the end of the data
+struct batch_limits {
+	/// The maximum number of records in a batch
+	size_t records = 1024;
+	/// Deliver the batch once the content of its fields reaches this many bytes
+	size_t bytes = 1024 * 1024;
+};
+
+/// A run of consecutive records sharing a single buffer for their field content.  Only valid within the
+/// callback it was passed to.
+class record_batch {
+public:
+	class iterator {
+	public:
+		iterator(const record_batch* batch, size_t index) noexcept : _batch(batch), _index(index) {}
+
+		inline csv::record_view operator*() const { return (*_batch)[_index]; }
+		inline iterator& operator++() { _index++; return *this; }
+		inline bool operator==(const iterator& other) const { return _index == other._index; }
+		inline bool operator!=(const iterator& other) const { return _index != other._index; }
+
+	private:
+		const record_batch* _batch;
+		size_t _index;
+	};
+
+	/// The number of records in the batch
+	inline size_t size() const { return _rows.size(); }
+	inline bool empty() const { return _rows.empty(); }
+
+	/// The total size of the field content in the batch
+	inline size_t content_size() const { return _bytes.size(); }
+
+	inline csv::record_view operator[](const size_t offset) const {
+		const size_t first = _starts[offset];
+		const size_t last = (offset + 1 < _starts.size()) ? _starts[offset + 1] : _offsets.size();
+		return csv::record_view(_fields.data() + first, last - first, _rows[offset]);
+	}
+
+	inline iterator begin() const { return iterator(this, 0); }
+	inline iterator end() const { return iterator(this, size()); }
+
+	inline void clear() {
+		_bytes.clear();
+		_offsets.clear();
+		_starts.clear();
+		_rows.clear();
+	}
+
+	// Building the batch
+
+	/// Reserve space for 'bytes' bytes of field content
+	inline void reserve(size_t bytes) {
+		_bytes.reserve(bytes);
+	}
+
+	/// Start a new record at the end of the batch
+	inline void begin_record(size_t row) {
+		_starts.push_back(_offsets.size());
+		_rows.push_back(row);
+	}
+
+	/// Remove the record started by the last call to begin_record()
+	inline void discard_record() {
+		_bytes.resize(_starts.back() == 0 ? 0 : _offsets[_starts.back() - 1]);
+		_offsets.resize(_starts.back());
+		_starts.pop_back();
+		_rows.pop_back();
+	}
+
+	/// The buffer to append the content of the current field to
+	inline std::string& bytes() { return _bytes; }
+
+	/// The current field is complete
+	inline void end_field() { _offsets.push_back(_bytes.size()); }
+
+	/// Is the record started by the last call to begin_record() empty?
+	inline bool last_empty() const {
+		const size_t first = _starts.back();
+		const size_t start = (first == 0) ? 0 : _offsets[first - 1];
+		return _bytes.size() == start;
+	}
+
+	/// Append a copy of 'record'
+	inline void add(const csv::record_view& record) {
+		begin_record(record.row);
+		for (const auto& field: record) {
+			_bytes.append(field.content.data(), field.content.size());
+			end_field();
+		}
+	}
+
+	/// Add 'offset' to the row number of each record.  Call before finish()
+	inline void offset_rows(size_t offset) {
+		for (auto& row: _rows) {
+			row += offset;
+		}
+	}
+
+	/// Make the field views.  Called once the batch is complete, when the buffer won't move again
+	inline void finish() {
+		_fields.resize(_offsets.size());
+		size_t start = 0;
+		for (size_t record = 0; record < _starts.size(); record++) {
+			const size_t first = _starts[record];
+			const size_t last = (record + 1 < _starts.size()) ? _starts[record + 1] : _offsets.size();
+			for (size_t i = first; i < last; i++) {
+				_fields[i].row = _rows[record];
+				_fields[i].column = i - first;
+				_fields[i].content = std::string_view(_bytes.data() + start, _offsets[i] - start);
+				start = _offsets[i];
+			}
+		}
+	}
+
+	/// Has the batch reached either of the limits?
+	inline bool full(const batch_limits& limits) const {
+		return (limits.records > 0 && _rows.size() >= limits.records) ||
+			(limits.bytes > 0 && _bytes.size() >= limits.bytes);
+	}
+
+private:
+	std::string _bytes;
+	/// The end offset in _bytes of each field
+	std::vector<size_t> _offsets;
+	/// The index of the first field of each record
+	std::vector<size_t> _starts;
+	std::vector<size_t> _rows;
+	std::vector<field_view> _fields;
+};
+
 typedef std::function<bool(const field&)> FieldCallback;
 typedef std::function<bool(const record&, double progress)> RecordCallback;
+typedef std::function<bool(const record_view&, double progress)> RecordViewCallback;
+typedef std::function<bool(const record_batch&, double progress)> RecordBatchCallback;
 
+/// Parse using the IDataSource interface (one virtual call per character)
 csv::State parse(IDataSource& parser,
 				 csv::FieldCallback emitField,
 				 csv::RecordCallback emitRecord);
+
+/// Parse using a concrete data source type.  When 'Source' is a final class (eg. utf8::StringDataSource)
+/// the per-character calls are resolved statically and can be inlined into the parse loop.
+template <typename Source>
+csv::State parse(Source& parser,
+				 csv::FieldCallback emitField,
+				 csv::RecordCallback emitRecord);
+
+/// Parse without copying each field into a csv::record.  Field content is gathered into a reused
+/// csv::record_arena, so once it has grown to fit the largest record no further allocations are made
+/// (assuming the data source does not allocate).  The record is only valid for the duration of the callback.
+csv::State parse(IDataSource& parser,
+				 csv::RecordViewCallback emitRecord);
+
+template <typename Source>
+csv::State parse(Source& parser,
+				 csv::RecordViewCallback emitRecord);
+
+/// Parse, delivering records in batches rather than one at a time.  The progress is only calculated once
+/// per batch.
+csv::State parse(IDataSource& parser,
+				 const csv::batch_limits& limits,
+				 csv::RecordBatchCallback emitBatch);
+
+template <typename Source>
+csv::State parse(Source& parser,
+				 const csv::batch_limits& limits,
+				 csv::RecordBatchCallback emitBatch);
+};
+
+// MARK: - Parser implementation
+
+#define CSV_RETURN_IF_CANCELLED(parser) 	if (parser.cancelled.load(std::memory_order_relaxed)) { return InternalState::Canceled; }
+
+namespace csv {
+namespace detail {
+
+	/// Internal parser state
+	typedef enum InternalState {
+		EndOfField = 0,
+		EndOfLine = 1,
+		EndOfFile = 2,
+		Canceled = 3
+	} InternalState;
+
+	template <typename Source>
+	inline bool parseSeparator(Source& parser) {
+		if (parser.is_separator()) {
+			// If a separator, then move to the next character
+			return parser.next();
+		}
+		return false;
+	}
+
+	template <typename Source>
+	inline void skipWhitespace(Source& parser) {
+		while (parser.is_whitespace() && parser.next()) {
+			// Just continue reading.
+		}
+	}
+
+	template <typename Source>
+	InternalState parseEscapedString(Source& parser) {
+		// escaped = DQUOTE *(TEXTDATA / COMMA / CR / LF / 2DQUOTE) DQUOTE
+
+		// Quote has already been read.  Move to the next char
+		if (!parser.next()) {
+			return InternalState::EndOfFile;
+		}
+
+		while (true) {
+
+			CSV_RETURN_IF_CANCELLED(parser);
+
+			if (parser.is_quote()) {
+				if (!parser.next()) {
+					return InternalState::EndOfFile;
+				}
+				else if (parser.is_quote()) {
+					// 2DQUOTE -- push the quote into the field.
+					parser.push();
+				}
+				else {
+					// If we've hit the end of an escaped string, we should attempt to locate either
+					// 1. The next separator
+					// 2. End of line
+					while (true) {
+						if (parser.is_eol()) {
+							return InternalState::EndOfLine;
+						}
+
+						if (parser.is_separator()) {
+							return InternalState::EndOfField;
+						}
+
+						if (!parser.next()) {
+							return InternalState::EndOfFile;
+						}
+					}
+				}
+			}
+			else {
+				parser.push();
+			}
+
+			if (!parser.next()) {
+				return InternalState::EndOfFile;
+			}
+		}
+		return InternalState::EndOfField;
+	}
+
+	template <typename Source>
+	InternalState parseUnescapedString(Source& parser) {
+		// non-escaped = *TEXTDATA
+		while (true) {
+
+			CSV_RETURN_IF_CANCELLED(parser);
+
+			if (parser.is_separator()) {
+				return InternalState::EndOfField;
+			}
+			else if (parser.is_eol()) {
+				return InternalState::EndOfLine;
+			}
+			else if (parser.is_quote()) {
+				if (!parser.next()) {
+					return InternalState::EndOfFile;
+				}
+
+				if (parser.is_quote()) {
+					// Double quote. This is fine.
+					parser.push();
+				}
+				else {
+					// This is an error case.  A single quote in an unescaped
+					// string is bad.  Lets try to recover (assume single quote)
+					parser.back();
+					parser.push();
+				}
+			}
+			else {
+				parser.push();
+			}
+
+			// Move to the next character
+			if (!parser.next()) {
+				return InternalState::EndOfFile;
+			}
+		}
+		return InternalState::EndOfField;
+	}
+
+	template <typename Source>
+	InternalState parseField(Source& parser, bool isFirstFieldForRow) {
+		//  field = (escaped / non-escaped)
+
+		parser.clear_field();
+
+		// If the first character on the line is a comment character, then
+		// skip the line completely.  Only support for single line comments
+		if (isFirstFieldForRow && parser.is_comment()) {
+			// Skip to end of the line
+			while (!parser.is_eol()) {
+				if (!parser.next()) {
+					return InternalState::EndOfFile;
+				}
+			}
+			return InternalState::EndOfLine;
+		}
+
+		if (parser.trimLeadingWhitespace) {
+			skipWhitespace(parser);
+		}
+
+		if (parser.is_eol()) {
+			// Had whitespace before the end of the line, so treat it as
+			// a blank field
+			return InternalState::EndOfLine;
+		}
+
+		InternalState returnState = InternalState::EndOfField;
+		if (parser.is_quote()) {
+			returnState = parseEscapedString(parser);
+		}
+		else {
+			returnState = parseUnescapedString(parser);
+		}
+
+		return returnState;
+	}
+
+	template <typename Source>
+	InternalState parseRecord(Source& parser,
+							  csv::record& record,
+							  const csv::FieldCallback& emitField) {
+
+		//  record = field *(COMMA field)
+
+		csv::field field;
+
+		InternalState state = InternalState::EndOfField;
+		bool isNewRecord = true;
+		size_t column = 0;
+
+		while (true) {
+			CSV_RETURN_IF_CANCELLED(parser);
+			state = parseField(parser, isNewRecord);
+			CSV_RETURN_IF_CANCELLED(parser);
+
+			field.content = parser.field();
+			field.column = column;
+			field.row = record.row;
+
+			record.add(field);
+			if (emitField && emitField(field) == false) {
+				return InternalState::EndOfFile;
+			}
+
+			isNewRecord = false;
+
+			switch (state) {
+				case InternalState::EndOfField:
+					if (!parseSeparator(parser)) {
+						// We have a separator at the last character in a file, which means an
+						// empty field right at the end.
+						field.content = "";
+						field.column = column + 1;
+						field.row = record.row;
+						record.add(field);
+						return InternalState::EndOfFile;
+					}
+					break;
+				default:
+					// We have finished the current record
+					return state;
+			}
+			column++;
+		}
+	}
+
+	/// Parse a record into a csv::record_arena or csv::record_batch
+	template <typename Source, typename Arena>
+	InternalState parseRecord(Source& parser, Arena& record) {
+
+		//  record = field *(COMMA field)
+
+		InternalState state = InternalState::EndOfField;
+		bool isNewRecord = true;
+
+		while (true) {
+			CSV_RETURN_IF_CANCELLED(parser);
+			state = parseField(parser, isNewRecord);
+			CSV_RETURN_IF_CANCELLED(parser);
+
+			parser.append_field(record.bytes());
+			record.end_field();
+
+			isNewRecord = false;
+
+			switch (state) {
+				case InternalState::EndOfField:
+					if (!parseSeparator(parser)) {
+						// A separator at the last character in a file.  Add an empty field
+						record.end_field();
+						return InternalState::EndOfFile;
+					}
+					break;
+				default:
+					// We have finished the current record
+					return state;
+			}
+		}
+	}
+
+	/// Tells the source when the parse returns (see IDataSource::parse_ended())
+	template <typename Source>
+	struct parse_scope {
+		Source& parser;
+		~parse_scope() { parser.parse_ended(); }
+	};
+
+	inline State completion(InternalState state) {
+		switch (state) {
+			case InternalState::Canceled:
+				return State::Cancelled;
+			case InternalState::EndOfFile:
+				return State::Complete;
+			default:
+				assert(false);
+				return State::Error;
+		}
+	}
+};
+
+	template <typename Source>
+	State parse(Source& parser, FieldCallback emitField, RecordCallback emitRecord) {
+		//  file = [header CRLF] record *(CRLF record) [CRLF]
+
+		using detail::InternalState;
+
+		InternalState state = InternalState::EndOfFile;
+		parser.cancelled = false;
+		const detail::parse_scope<Source> scope { parser };
+
+		// Move to the first character
+		if (!parser.next()) {
+			// File is empty.  Do nothing
+			return State::Complete;
+		}
+
+		csv::record record;
+
+		size_t row = 0;
+		do {
+			record.content.clear();
+			record.row = row;
+
+			state = detail::parseRecord(parser, record, emitField);
+
+			if (!parser.skipBlankLines || !record.empty()) {
+				row++;
+				if (emitRecord && (emitRecord(record, parser.progress()) == false)) {
+					return State::Complete;
+				}
+			}
+
+			if (!parser.next()) {
+				return State::Complete;
+			}
+		}
+		while (state != InternalState::Canceled && state != InternalState::EndOfFile);
+
+		return detail::completion(state);
+	}
+
+	template <typename Source>
+	State parse(Source& parser, RecordViewCallback emitRecord) {
+		using detail::InternalState;
+
+		InternalState state = InternalState::EndOfFile;
+		parser.cancelled = false;
+		const detail::parse_scope<Source> scope { parser };
+
+		// Move to the first character
+		if (!parser.next()) {
+			// File is empty.  Do nothing
+			return State::Complete;
+		}
+
+		csv::record_arena record;
+
+		size_t row = 0;
+		do {
+			record.clear();
+			record.row = row;
+
+			state = detail::parseRecord(parser, record);
+
+			const csv::record_view view = record.view();
+			if (!parser.skipBlankLines || !view.empty()) {
+				row++;
+				if (emitRecord && (emitRecord(view, parser.progress()) == false)) {
+					return State::Complete;
+				}
+			}
+
+			if (!parser.next()) {
+				return State::Complete;
+			}
+		}
+		while (state != InternalState::Canceled && state != InternalState::EndOfFile);
+
+		return detail::completion(state);
+	}
+
+	template <typename Source>
+	State parse(Source& parser, const batch_limits& limits, RecordBatchCallback emitBatch) {
+		using detail::InternalState;
+
+		InternalState state = InternalState::EndOfFile;
+		parser.cancelled = false;
+		const detail::parse_scope<Source> scope { parser };
+
+		// Move to the first character
+		if (!parser.next()) {
+			// File is empty.  Do nothing
+			return State::Complete;
+		}
+
+		csv::record_batch batch;
+
+		const auto deliver = [&]() -> bool {
+			if (batch.empty()) {
+				return true;
+			}
+			batch.finish();
+			const bool more = !emitBatch || emitBatch(batch, parser.progress());
+			batch.clear();
+			return more;
+		};
+
+		size_t row = 0;
+		do {
+			batch.begin_record(row);
+
+			state = detail::parseRecord(parser, batch);
+
+			if (parser.skipBlankLines && batch.last_empty()) {
+				batch.discard_record();
+			}
+			else {
+				row++;
+				if (batch.full(limits) && !deliver()) {
+					return State::Complete;
+				}
+			}
+
+			if (!parser.next()) {
+				deliver();
+				return State::Complete;
+			}
+		}
+		while (state != InternalState::Canceled && state != InternalState::EndOfFile);
+
+		deliver();
+		return detail::completion(state);
+	}
 };
+
+#undef CSV_RETURN_IF_CANCELLED
@@ -0,0 +1,118 @@
+//
+//  push_parser.cpp
+//
+//  MIT license
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+//  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all copies or substantial
+//  portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+//  WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+//  OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+//  OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "push_parser.hpp"
+
+#include <algorithm>
+
+namespace {
+	// BOM definitions
+	const char _BOMS[] = { '\xEF', '\xBB', '\xBF' };
+	const size_t _BOMS_SIZE = 3;
+};
+
+namespace csv {
+
+	push_parser::push_parser(RecordViewCallback emitRecord, const structural::dialect& options)
+	: _emitRecord(emitRecord), _tokens(options), _skipBlankLines(options.skipBlankLines) {
+	}
+
+	void push_parser::reset() {
+		_tokens.reset();
+		_size = 0;
+		_stopped = false;
+		_finished = false;
+		_bom = 0;
+		_checkBOM = true;
+	}
+
+	bool push_parser::feed(const char* data, size_t size) {
+		if (_stopped || _finished) {
+			return false;
+		}
+		_size += size;
+
+		if (_checkBOM) {
+			// Skip a BOM at the start of the input, which may itself be split between pieces
+			size_t matched = 0;
+			while (_bom < _BOMS_SIZE && matched < size && data[matched] == _BOMS[_bom]) {
+				_bom++;
+				matched++;
+			}
+
+			if (_bom == _BOMS_SIZE) {
+				_checkBOM = false;
+				data += matched;
+				size -= matched;
+			}
+			else if (matched == size) {
+				// Still could be a BOM
+				return true;
+			}
+			else {
+				// Not a BOM after all.  Any part of it held back from earlier pieces is content
+				_checkBOM = false;
+				const size_t held = _bom - matched;
+				if (held > 0) {
+					_tokens.feed(_BOMS, held);
+					if (!deliver()) {
+						return false;
+					}
+				}
+			}
+		}
+
+		_tokens.feed(data, size);
+		return deliver();
+	}
+
+	bool push_parser::finish() {
+		if (_stopped || _finished) {
+			return false;
+		}
+
+		if (_checkBOM && _bom > 0 && _bom < _BOMS_SIZE) {
+			// The input was the start of a BOM and nothing else
+			_tokens.feed(_BOMS, _bom);
+			if (!deliver()) {
+				return false;
+			}
+		}
+
+		_finished = true;
+		_tokens.finish();
+		return deliver();
+	}
+
+	bool push_parser::deliver() {
+		const double progress = (expectedSize > 0) ? std::min(1.0, (double)_size / (double)expectedSize) : 0.0;
+
+		while (_tokens.next()) {
+			const csv::record_view& record = _tokens.record();
+			if (_skipBlankLines && record.empty()) {
+				continue;
+			}
+			if (_emitRecord && _emitRecord(record, progress) == false) {
+				_stopped = true;
+				return false;
+			}
+		}
+		return true;
+	}
+};
@@ -0,0 +1,76 @@
+//
+//  push_parser.hpp
+//
+//  MIT license
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+//  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all copies or substantial
+//  portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+//  WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+//  OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+//  OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#pragma once
+
+#include <csv/parser.hpp>
+#include <csv/structural.hpp>
+
+namespace csv {
+
+/// Parses UTF-8 input that is pushed to it in pieces, eg. as it arrives from a socket.
+///
+///     csv::push_parser parser([](const csv::record_view& record, double progress) -> bool { ... });
+///     parser.feed(data, size);
+///     ...
+///     parser.finish();
+///
+/// The input can be split anywhere, including within a quoted field or between the CR and LF of a line
+/// ending.  Each record is passed to the callback as soon as its line ending has been fed.  All parser state
+/// is held in the object (the only content copied between calls to feed() is that of an incomplete record),
+/// so there is no need to buffer the input.
+class push_parser {
+public:
+	push_parser(csv::RecordViewCallback emitRecord, const structural::dialect& options = structural::dialect());
+
+	push_parser(const push_parser&) = delete;
+	push_parser& operator=(const push_parser&) = delete;
+
+	/// The expected total size of the input in bytes, if known.  Used to report progress
+	size_t expectedSize = 0;
+
+	/// Parse the next piece of input.  The data only needs to remain valid for the duration of the call.
+	/// Returns false if the callback has stopped parsing (further input is ignored)
+	bool feed(const char* data, size_t size);
+
+	/// No more input.  Delivers the final record if it has no line ending.
+	bool finish();
+
+	/// Discard all state, ready for new input
+	void reset();
+
+	/// The number of bytes fed so far
+	inline size_t size() const { return _size; }
+
+private:
+	bool deliver();
+
+	csv::RecordViewCallback _emitRecord;
+	structural::tokenizer _tokens;
+	bool _skipBlankLines;
+
+	size_t _size = 0;
+	bool _stopped = false;
+	bool _finished = false;
+
+	// The number of bytes of a leading BOM seen so far
+	size_t _bom = 0;
+	bool _checkBOM = true;
+};
+};
@@ -0,0 +1,158 @@
+//
+//  reader.hpp
+//
+//  MIT license
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+//  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all copies or substantial
+//  portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+//  WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+//  OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+//  OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#pragma once
+
+#include <csv/parser.hpp>
+
+#include <cstddef>
+#include <iterator>
+
+namespace csv {
+
+/// Pull records from a data source one at a time, rather than having them pushed to a callback.
+///
+///     csv::reader records(source);
+///     for (const csv::record_view& record: records) {
+///         ...
+///     }
+///
+/// The reader is a single pass input range, so it can be used with std::ranges views (eg. filter, transform,
+/// take).  Records are produced on demand -- stopping early stops parsing.  The record returned from the iterator
+/// is only valid until the iterator is incremented.
+///
+/// When 'Source' is a concrete (final) data source the parser is inlined into the caller's loop.
+template <typename Source = IDataSource>
+class reader {
+public:
+	class iterator {
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = csv::record_view;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const csv::record_view*;
+		using reference = const csv::record_view&;
+
+		iterator() noexcept {}
+		explicit iterator(reader* owner) noexcept : _reader(owner) {}
+
+		inline reference operator*() const { return _reader->_view; }
+		inline pointer operator->() const { return &_reader->_view; }
+
+		inline iterator& operator++() {
+			_reader->advance();
+			return *this;
+		}
+		inline void operator++(int) { ++*this; }
+
+		inline bool at_end() const { return _reader == nullptr || _reader->_done; }
+
+		friend inline bool operator==(const iterator& left, const iterator& right) {
+			return left.at_end() == right.at_end();
+		}
+		friend inline bool operator!=(const iterator& left, const iterator& right) {
+			return !(left == right);
+		}
+
+	private:
+		reader* _reader = nullptr;
+	};
+
+	explicit reader(Source& source) noexcept
+	: _source(source) {}
+
+	reader(const reader&) = delete;
+	reader& operator=(const reader&) = delete;
+
+	/// The first unread record.  The data can only be read once, so calling begin() again continues from
+	/// where the previous iteration stopped.
+	iterator begin() {
+		if (!_started) {
+			_started = true;
+			advance();
+		}
+		return iterator(this);
+	}
+
+	iterator end() { return iterator(); }
+
+	/// How reading ended.  Only meaningful once the end has been reached
+	inline csv::State state() const { return _state; }
+
+	/// Move to the next record.  Returns false at the end of the data
+	bool advance();
+
+private:
+	Source& _source;
+
+	bool _started = false;
+	bool _primed = false;
+	bool _done = false;
+	csv::State _state = csv::State::Complete;
+	detail::InternalState _last = detail::InternalState::EndOfField;
+
+	size_t _row = 0;
+	csv::record_arena _record;
+	csv::record_view _view;
+};
+
+// MARK: - Implementation
+
+template <typename Source>
+bool reader<Source>::advance() {
+	// The same sequence of steps as csv::parse, broken up at each record
+
+	using detail::InternalState;
+
+	while (!_done) {
+		if (!_primed) {
+			_primed = true;
+			_source.cancelled = false;
+
+			// Move to the first character
+			if (!_source.next()) {
+				// File is empty.  Do nothing
+				_done = true;
+				break;
+			}
+		}
+		else if (!_source.next()) {
+			_done = true;
+			break;
+		}
+		else if (_last == InternalState::Canceled || _last == InternalState::EndOfFile) {
+			_state = detail::completion(_last);
+			_done = true;
+			break;
+		}
+
+		_record.clear();
+		_record.row = _row;
+
+		_last = detail::parseRecord(_source, _record);
+
+		_view = _record.view();
+		if (!_source.skipBlankLines || !_view.empty()) {
+			_row++;
+			return true;
+		}
+	}
+	return false;
+}
+};
@@ -0,0 +1,151 @@
+//
+//  records.hpp
+//
+//  MIT license
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+//  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all copies or substantial
+//  portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+//  WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+//  OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+//  OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#pragma once
+
+#include <csv/structural.hpp>
+
+#if __has_include(<generator>)
+#include <generator>
+#endif
+
+#if !defined(__cpp_lib_generator)
+#if !defined(__cpp_impl_coroutine)
+#error "csv::records needs C++20 coroutines.  Use csv::reader (csv/reader.hpp) to pull records instead"
+#endif
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <utility>
+#endif
+
+namespace csv {
+
+#if defined(__cpp_lib_generator)
+
+	/// What csv::records returns
+	using record_generator = std::generator<const csv::record_view&>;
+
+#else
+
+	/// What csv::records returns: a stand-in for std::generator<const csv::record_view&> where the standard
+	/// library doesn't have it yet (eg. before C++23), providing just what a range-based for loop needs
+	class record_generator {
+	public:
+		struct promise_type {
+			const csv::record_view* current = nullptr;
+			std::exception_ptr error;
+
+			record_generator get_return_object() noexcept {
+				return record_generator(std::coroutine_handle<promise_type>::from_promise(*this));
+			}
+			std::suspend_always initial_suspend() const noexcept { return {}; }
+			std::suspend_always final_suspend() const noexcept { return {}; }
+			std::suspend_always yield_value(const csv::record_view& record) noexcept {
+				current = &record;
+				return {};
+			}
+			void return_void() const noexcept {}
+			void unhandled_exception() noexcept { error = std::current_exception(); }
+		};
+
+		using handle = std::coroutine_handle<promise_type>;
+
+		class iterator {
+		public:
+			using iterator_category = std::input_iterator_tag;
+			using difference_type = std::ptrdiff_t;
+			using value_type = csv::record_view;
+			using reference = const csv::record_view&;
+			using pointer = const csv::record_view*;
+
+			iterator() = default;
+			explicit iterator(handle coroutine) : _coroutine(coroutine) {}
+
+			reference operator*() const { return *_coroutine.promise().current; }
+			pointer operator->() const { return _coroutine.promise().current; }
+
+			iterator& operator++() {
+				record_generator::resume(_coroutine);
+				return *this;
+			}
+			void operator++(int) { ++*this; }
+
+			bool operator==(std::default_sentinel_t) const { return !_coroutine || _coroutine.done(); }
+
+		private:
+			handle _coroutine;
+		};
+
+		record_generator(record_generator&& other) noexcept : _coroutine(std::exchange(other._coroutine, nullptr)) {}
+		record_generator& operator=(record_generator&& other) noexcept {
+			std::swap(_coroutine, other._coroutine);
+			return *this;
+		}
+		~record_generator() {
+			if (_coroutine) {
+				_coroutine.destroy();
+			}
+		}
+
+		/// Runs the coroutine to the first record.  Like std::generator, can only be iterated once
+		iterator begin() {
+			resume(_coroutine);
+			return iterator(_coroutine);
+		}
+		std::default_sentinel_t end() const noexcept { return {}; }
+
+	private:
+		explicit record_generator(handle coroutine) : _coroutine(coroutine) {}
+
+		static void resume(handle coroutine) {
+			coroutine.resume();
+			if (coroutine.done() && coroutine.promise().error) {
+				std::rethrow_exception(coroutine.promise().error);
+			}
+		}
+
+		handle _coroutine;
+	};
+
+#endif
+
+	/// The records of a UTF-8 data source, parsed on demand by a coroutine.
+	///
+	///     for (const csv::record_view& record: csv::records(source)) {
+	///         ...
+	///     }
+	///
+	/// The parse state lives in the coroutine frame (see csv::structural::cursor), so the generators for several
+	/// sources can be advanced in turn on a single thread.  Each record is only valid until the generator is
+	/// resumed.  Blank lines are skipped if the source's skipBlankLines is set.  Returns a std::generator
+	/// where the standard library has one; otherwise a minimal generator that works with a range-based for
+	/// loop.  Needs C++20 coroutines (see csv::reader otherwise).
+	inline record_generator records(utf8::DataSource& source) {
+		structural::cursor cursor(source);
+		while (cursor.next()) {
+			if (source.skipBlankLines && cursor.record().empty()) {
+				continue;
+			}
+			co_yield cursor.record();
+		}
+	}
+};
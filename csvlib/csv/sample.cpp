@@ -0,0 +1,208 @@
+//
+//  sample.cpp
+//
+//  MIT license
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+//  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all copies or substantial
+//  portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+//  WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+//  OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+//  OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "sample.hpp"
+#include "index.hpp"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <random>
+#include <set>
+
+namespace {
+
+	// How far is read around each random offset: the lookahead used to find the start of the next record, and
+	// the block that it is parsed from
+	const size_t _WINDOW = 64 * 1024;
+
+	// Random offsets that land on records already picked are tried again, up to this many times per record
+	// wanted, before giving up and reading the whole file
+	const size_t _ATTEMPTS = 8;
+
+	bool sameDialect(const csv::structural::dialect& a, const csv::structural::dialect& b) {
+		return a.separator == b.separator && a.comment == b.comment &&
+			a.trimLeadingWhitespace == b.trimLeadingWhitespace && a.skipBlankLines == b.skipBlankLines;
+	}
+
+	void setDialect(csv::utf8::DataSource& source, const csv::structural::dialect& options) {
+		source.separator = options.separator;
+		source.comment = options.comment;
+		source.trimLeadingWhitespace = options.trimLeadingWhitespace;
+		source.skipBlankLines = options.skipBlankLines;
+	}
+
+	/// Parse the first record of 'source' into 'record'.  Returns false if there isn't one
+	bool firstRecord(csv::utf8::DataSource& source, csv::record& record) {
+		bool found = false;
+		csv::structural::parse(source, [&](const csv::record_view& view, double) {
+			record = view.to_record();
+			found = true;
+			return false;
+		});
+		return found;
+	}
+
+	/// Renumber a record (and its fields)
+	void setRow(csv::record& record, size_t row) {
+		record.row = row;
+		for (auto& field: record.content) {
+			field.row = row;
+		}
+	}
+
+	/// Sample using the index of the file: pick 'k' different rows, and read each of them
+	std::vector<csv::record> sampleIndexed(const std::string& path,
+										   const csv::index::row_index& index,
+										   size_t k,
+										   std::mt19937_64& random) {
+		// Floyd's algorithm picks each set of k rows with equal probability
+		std::set<size_t> rows;
+		for (size_t candidate = index.rows - k; candidate < index.rows; candidate++) {
+			const size_t row = std::uniform_int_distribution<size_t>(0, candidate)(random);
+			rows.insert(rows.count(row) ? candidate : row);
+		}
+
+		std::vector<csv::record> records;
+		records.reserve(k);
+		for (const size_t row: rows) {
+			csv::utf8::RangeFileDataSource source;
+			source.bufferSize = _WINDOW;
+			csv::record record;
+			// Open to the end of the file, so the start of the row is only located once (firstRecord stops
+			// after it anyway)
+			if (!csv::index::seek(source, path, index, row) || !firstRecord(source, record)) {
+				return std::vector<csv::record>();
+			}
+			setRow(record, row);
+			records.push_back(std::move(record));
+		}
+		return records;
+	}
+
+	/// Sample from random offsets in a file of 'size' bytes.  Returns false if too many of the offsets led
+	/// to records already picked (ie. the file doesn't have many more records than 'k')
+	bool sampleOffsets(const std::string& path,
+					   size_t size,
+					   size_t k,
+					   const csv::structural::dialect& options,
+					   std::mt19937_64& random,
+					   std::vector<csv::record>& records) {
+		std::uniform_int_distribution<size_t> offsets(0, size - 1);
+
+		// The records picked, by the offset they start at
+		std::vector<std::pair<size_t, csv::record>> picked;
+		std::set<size_t> starts;
+		for (size_t attempt = 0; picked.size() < k; attempt++) {
+			if (attempt == k * _ATTEMPTS) {
+				return false;
+			}
+
+			csv::utf8::RangeFileDataSource source;
+			setDialect(source, options);
+			source.bufferSize = _WINDOW;
+			source.lookahead = _WINDOW;
+			if (!source.open(path, offsets(random), size)) {
+				return false;
+			}
+
+			csv::record record;
+			if (starts.count(source.begin()) || !firstRecord(source, record)) {
+				// Already picked, or the offset was in the last record
+				continue;
+			}
+			starts.insert(source.begin());
+			setRow(record, csv::unknownRow);
+			picked.emplace_back(source.begin(), std::move(record));
+		}
+
+		std::sort(picked.begin(), picked.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+		records.clear();
+		for (auto& entry: picked) {
+			records.push_back(std::move(entry.second));
+		}
+		return true;
+	}
+};
+
+namespace csv {
+
+	std::vector<csv::record> sample(const std::string& path, size_t k, uint64_t seed, const structural::dialect& options) {
+		std::mt19937_64 random(seed);
+		if (k == 0) {
+			return std::vector<csv::record>();
+		}
+
+		index::row_index index;
+		if (index::load(path, index) && sameDialect(index.options, options)) {
+			if (k < index.rows) {
+				return sampleIndexed(path, index, k, random);
+			}
+		}
+		else {
+			struct stat info;
+			if (::stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+				return std::vector<csv::record>();
+			}
+
+			// Each record picked costs reading about two windows
+			const size_t size = (size_t)info.st_size;
+			std::vector<csv::record> records;
+			if (size > k * 2 * _WINDOW && sampleOffsets(path, size, k, options, random, records)) {
+				return records;
+			}
+		}
+
+		// Read the whole file
+		utf8::MappedFileDataSource source;
+		if (!source.open(path)) {
+			return std::vector<csv::record>();
+		}
+		setDialect(source, options);
+		return sample(source, k, seed);
+	}
+
+	std::vector<csv::record> sample(utf8::DataSource& source, size_t k, uint64_t seed) {
+		std::mt19937_64 random(seed);
+		std::vector<csv::record> records;
+		if (k == 0) {
+			return records;
+		}
+		records.reserve(k);
+
+		// Record n (counting from 0) replaces a random one of the k kept with probability k / (n + 1)
+		size_t count = 0;
+		structural::parse(source, [&](const csv::record_view& view, double) {
+			if (records.size() < k) {
+				records.push_back(view.to_record());
+			}
+			else {
+				const size_t slot = std::uniform_int_distribution<size_t>(0, count)(random);
+				if (slot < k) {
+					records[slot] = view.to_record();
+				}
+			}
+			count++;
+			return true;
+		});
+
+		std::sort(records.begin(), records.end(), [](const csv::record& a, const csv::record& b) { return a.row < b.row; });
+		return records;
+	}
+};
@@ -0,0 +1,62 @@
+//
+//  sample.hpp
+//
+//  MIT license
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+//  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all copies or substantial
+//  portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+//  WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+//  OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+//  OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#pragma once
+
+#include <csv/parser.hpp>
+#include <csv/structural.hpp>
+#include <csv/datasource/utf8/DataSource.hpp>
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// Picking a few records at random from a large file (eg. to infer its schema) without parsing all of it.
+//
+//     const std::vector<csv::record> records = csv::sample("big.csv", 1000, seed);
+
+namespace csv {
+
+	/// The row number of a sampled record whose row isn't known
+	const size_t unknownRow = (size_t)-1;
+
+	/// Pick 'k' different records of the UTF-8 file 'path' at random, returned in the order they appear in
+	/// the file.  The same 'seed' picks the same records.  Fewer are returned if the file has fewer records,
+	/// and none if it can't be read.
+	///
+	/// If the file has an up to date index (see csv::index) built with the same dialect, each record of the file
+	/// is equally likely to be picked, and only the picked records (and those between them and the closest
+	/// indexed records) are parsed.
+	///
+	/// Otherwise records are found from random offsets in the file, starting from the first record that
+	/// starts at or after each offset (see utf8::RangeFileDataSource).  This reads only around the offsets, but
+	/// favours records following long ones, and their row numbers aren't known (they are csv::unknownRow).
+	/// A file small enough that reading all of it costs less is read with sample(source, ...) instead.
+	std::vector<csv::record> sample(const std::string& path,
+									size_t k,
+									uint64_t seed,
+									const structural::dialect& options = structural::dialect());
+
+	/// Pick 'k' different records of a data source at random (by reservoir sampling), returned in the order
+	/// they appear in the input.  Every record is equally likely to be picked, but the whole input is parsed
+	/// (using the two-stage parser), so this suits inputs that can only be read through once (eg. a pipe or a
+	/// compressed file).  Fewer are returned if there are fewer records.
+	std::vector<csv::record> sample(utf8::DataSource& source, size_t k, uint64_t seed);
+};
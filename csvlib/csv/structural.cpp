@@ -0,0 +1,752 @@
+//
+//  structural.cpp
+//
+//  MIT license
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+//  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all copies or substantial
+//  portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+//  WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+//  OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+//  OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "structural.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define CSV_STRUCTURAL_X86 1
+#include <immintrin.h>
+#endif
+
+// MARK: - Stage one
+
+namespace {
+
+	csv::structural::block classifyScalar(const char* data, char separator) {
+		csv::structural::block result;
+		for (unsigned int i = 0; i < 64; i++) {
+			const char c = data[i];
+			const uint64_t bit = 1ULL << i;
+			if (c == '\"') { result.quote |= bit; }
+			if (c == separator) { result.separator |= bit; }
+			if (c == '\r' || c == '\n') { result.eol |= bit; }
+		}
+		return result;
+	}
+
+#ifdef CSV_STRUCTURAL_X86
+
+	__attribute__((target("avx2")))
+	csv::structural::block classifyAVX2(const char* data, char separator) {
+		const __m256i lo = _mm256_loadu_si256((const __m256i*)data);
+		const __m256i hi = _mm256_loadu_si256((const __m256i*)(data + 32));
+
+		const __m256i quote = _mm256_set1_epi8('\"');
+		const __m256i sep = _mm256_set1_epi8(separator);
+		const __m256i cr = _mm256_set1_epi8('\r');
+		const __m256i lf = _mm256_set1_epi8('\n');
+
+		#define CSV_MASK64(expr_lo, expr_hi) \
+			((uint64_t)(uint32_t)_mm256_movemask_epi8(expr_lo) | ((uint64_t)(uint32_t)_mm256_movemask_epi8(expr_hi) << 32))
+
+		csv::structural::block result;
+		result.quote = CSV_MASK64(_mm256_cmpeq_epi8(lo, quote), _mm256_cmpeq_epi8(hi, quote));
+		result.separator = CSV_MASK64(_mm256_cmpeq_epi8(lo, sep), _mm256_cmpeq_epi8(hi, sep));
+		result.eol = CSV_MASK64(_mm256_or_si256(_mm256_cmpeq_epi8(lo, cr), _mm256_cmpeq_epi8(lo, lf)),
+								_mm256_or_si256(_mm256_cmpeq_epi8(hi, cr), _mm256_cmpeq_epi8(hi, lf)));
+
+		#undef CSV_MASK64
+		return result;
+	}
+
+	__attribute__((target("sse4.2")))
+	csv::structural::block classifySSE42(const char* data, char separator) {
+		const __m128i quote = _mm_set1_epi8('\"');
+		const __m128i sep = _mm_set1_epi8(separator);
+		const __m128i cr = _mm_set1_epi8('\r');
+		const __m128i lf = _mm_set1_epi8('\n');
+
+		csv::structural::block result;
+		for (unsigned int i = 0; i < 4; i++) {
+			const __m128i chunk = _mm_loadu_si128((const __m128i*)(data + (i * 16)));
+			const unsigned int shift = i * 16;
+			result.quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, quote)) << shift;
+			result.separator |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, sep)) << shift;
+			result.eol |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, cr),
+																			  _mm_cmpeq_epi8(chunk, lf))) << shift;
+		}
+		return result;
+	}
+
+#endif
+
+	typedef csv::structural::block (*ClassifyFunction)(const char* data, char separator);
+
+	ClassifyFunction selectClassify() {
+#ifdef CSV_STRUCTURAL_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) {
+			return classifyAVX2;
+		}
+		if (__builtin_cpu_supports("sse4.2")) {
+			return classifySSE42;
+		}
+#endif
+		return classifyScalar;
+	}
+
+	const ClassifyFunction _classify = selectClassify();
+
+	inline unsigned int trailingZeros(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+		return (unsigned int)__builtin_ctzll(bits);
+#else
+		unsigned int count = 0;
+		while ((bits & 1) == 0) {
+			bits >>= 1;
+			count++;
+		}
+		return count;
+#endif
+	}
+};
+
+namespace csv {
+namespace structural {
+
+	block classify(const char* data, char separator) {
+		return _classify(data, separator);
+	}
+
+	uint64_t prefix_xor(uint64_t bits) {
+#if defined(CSV_STRUCTURAL_X86) && defined(__PCLMUL__)
+		// Carry-less multiplication by all ones
+		const __m128i all = _mm_set1_epi8((char)0xFF);
+		return (uint64_t)_mm_cvtsi128_si64(_mm_clmulepi64_si128(_mm_set_epi64x(0, (long long)bits), all, 0));
+#else
+		bits ^= bits << 1;
+		bits ^= bits << 2;
+		bits ^= bits << 4;
+		bits ^= bits << 8;
+		bits ^= bits << 16;
+		bits ^= bits << 32;
+		return bits;
+#endif
+	}
+};
+};
+
+// MARK: - Stage two
+
+namespace {
+	// Storage for characters that are not taken from the input
+	const char _quoteCharacter = '\"';
+	const char _spaceCharacter = ' ';
+};
+
+namespace csv {
+namespace structural {
+
+	tokenizer::tokenizer(const dialect& options)
+	: _dialect(options) {
+		_scratch.reserve(256);
+	}
+
+	void tokenizer::reset() {
+		_data = nullptr;
+		_size = 0;
+		_position = 0;
+		_finished = false;
+		_state = state::RecordStart;
+		_ready = false;
+		_trailing = false;
+		_column = 0;
+		_row = 0;
+		_run = nullptr;
+		_runLength = 0;
+		_inScratch = false;
+		_slots.clear();
+		_scratch.clear();
+		_view = csv::record_view();
+		_block = (size_t)-1;
+	}
+
+	void tokenizer::resume(size_t row, bool carriageReturn) {
+		reset();
+		_row = row;
+		_state = carriageReturn ? state::AfterCR : state::RecordStart;
+	}
+
+	void tokenizer::feed(const char* data, size_t size) {
+		_data = data;
+		_size = size;
+		_position = 0;
+		_block = (size_t)-1;
+	}
+
+	void tokenizer::finish() {
+		_finished = true;
+	}
+
+	void tokenizer::load(size_t base, size_t from) {
+		const size_t available = _size - base;
+
+		block masks;
+		if (available >= 64) {
+			masks = classify(_data + base, _dialect.separator);
+			_valid = ~0ULL;
+		}
+		else {
+			// Partial block at the end of the chunk.  The padding is masked out below so its value is irrelevant
+			char padded[64];
+			memset(padded, 0, sizeof(padded));
+			memcpy(padded, _data + base, available);
+			masks = classify(padded, _dialect.separator);
+			_valid = (1ULL << available) - 1;
+		}
+
+		_block = base;
+		_quote = masks.quote & _valid;
+		_delimiter = (masks.separator | masks.eol) & _valid;
+
+		// Quoted regions from 'from' onward, starting from the state stage two is currently in.
+		// Anything before 'from' has already been dealt with.
+		const uint64_t ahead = ~0ULL << (from - base);
+		const uint64_t carry = (_state == state::Escaped) ? ~0ULL : 0;
+		_inquote = prefix_xor(_quote & ahead) ^ carry;
+		_structural = _quote | (_delimiter & ~_inquote);
+	}
+
+	void tokenizer::flip(size_t position) {
+		// A quote that didn't open or close a quoted field.  Stage one assumed it did, so invert the
+		// quoted region mask from here to the end of the block
+		if (_block != (size_t)-1 && position >= _block && position < _block + 64) {
+			_inquote ^= ~0ULL << (position - _block);
+			_structural = _quote | (_delimiter & ~_inquote);
+		}
+	}
+
+	size_t tokenizer::find(size_t from) {
+		while (from < _size) {
+			const size_t base = from & ~(size_t)63;
+			if (base != _block) {
+				load(base, from);
+			}
+
+			const uint64_t candidates = _structural & (~0ULL << (from - base));
+			if (candidates != 0) {
+				return base + trailingZeros(candidates);
+			}
+			from = base + 64;
+		}
+		return _size;
+	}
+
+	inline void tokenizer::append(const char* data, size_t length) {
+		if (length == 0) {
+			return;
+		}
+
+		if (_inScratch) {
+			_scratch.append(data, length);
+		}
+		else if (_runLength == 0) {
+			_run = data;
+			_runLength = length;
+		}
+		else if (data == _run + _runLength) {
+			_runLength += length;
+		}
+		else {
+			// Not contiguous with what we have (eg. the second quote of a 2DQUOTE was dropped)
+			spill();
+			_scratch.append(data, length);
+		}
+	}
+
+	void tokenizer::spill() {
+		// Move the current field into the scratch buffer
+		_fieldStart = _scratch.size();
+		_scratch.append(_run, _runLength);
+		_run = nullptr;
+		_runLength = 0;
+		_inScratch = true;
+	}
+
+	void tokenizer::detach() {
+		// The current chunk is about to go away.  Copy anything in the current record that refers to it.
+		const size_t end = _scratch.size();
+		for (auto& entry: _slots) {
+			if (entry.data != nullptr) {
+				entry.offset = _scratch.size();
+				_scratch.append(entry.data, entry.length);
+				entry.data = nullptr;
+			}
+		}
+
+		if (_inScratch) {
+			// Keep the current field at the end of the scratch buffer, so it can still be appended to
+			const size_t length = end - _fieldStart;
+			if (end != _scratch.size()) {
+				std::rotate(_scratch.begin() + _fieldStart, _scratch.begin() + end, _scratch.end());
+				for (auto& entry: _slots) {
+					if (entry.offset >= end) {
+						entry.offset -= length;
+					}
+				}
+				_fieldStart = _scratch.size() - length;
+			}
+		}
+		else if (_runLength > 0) {
+			spill();
+		}
+	}
+
+	void tokenizer::startField(char c) {
+		// Called with the first character of a field after any leading whitespace
+		if (c == '\r' || c == '\n') {
+			endField();
+			endLine(c);
+		}
+		else if (c == '\"') {
+			_position++;
+			_state = state::Escaped;
+		}
+		else {
+			// Includes a separator (an empty field) which the unescaped state handles
+			_state = state::Unescaped;
+		}
+	}
+
+	void tokenizer::endField() {
+		slot field;
+		if (_inScratch) {
+			field.data = nullptr;
+			field.offset = _fieldStart;
+			field.length = _scratch.size() - _fieldStart;
+		}
+		else {
+			field.data = (_runLength > 0) ? _run : nullptr;
+			field.offset = 0;
+			field.length = _runLength;
+		}
+		_slots.push_back(field);
+
+		_run = nullptr;
+		_runLength = 0;
+		_inScratch = false;
+		_column++;
+	}
+
+	void tokenizer::endLine(char c) {
+		_position++;
+		_state = (c == '\r') ? state::AfterCR : state::RecordStart;
+		endRecord();
+	}
+
+	void tokenizer::endRecord() {
+		// The scratch buffer won't move again for this record, so the views can be made
+		_fields.resize(_slots.size());
+
+		bool blank = true;
+		for (size_t i = 0; i < _slots.size(); i++) {
+			const slot& field = _slots[i];
+			csv::field_view& view = _fields[i];
+			view.row = _row;
+			view.column = i;
+			view.content = (field.data != nullptr)
+				? std::string_view(field.data, field.length)
+				: std::string_view(_scratch.data() + field.offset, field.length);
+			blank = blank && (field.length == 0);
+		}
+
+		_view = csv::record_view(_fields.data(), _fields.size(), _row);
+		if (!_dialect.skipBlankLines || !blank) {
+			_row++;
+		}
+
+		_column = 0;
+		_ready = true;
+	}
+
+	bool tokenizer::next() {
+		if (_ready) {
+			// The caller has finished with the previous record
+			_ready = false;
+			_trailing = false;
+			_slots.clear();
+			_scratch.clear();
+		}
+
+		const char separator = _dialect.separator;
+
+		while (_position < _size) {
+			const char c = _data[_position];
+
+			switch (_state) {
+				case state::RecordStart:
+					if (_dialect.comment != '\0' && c == _dialect.comment) {
+						_position++;
+						_state = state::Comment;
+						break;
+					}
+					// Fall through
+
+				case state::FieldStart:
+					if (_dialect.trimLeadingWhitespace && c == ' ') {
+						_position++;
+						_state = state::Whitespace;
+						break;
+					}
+					startField(c);
+					break;
+
+				case state::Whitespace:
+					if (c == ' ') {
+						_position++;
+						break;
+					}
+					startField(c);
+					break;
+
+				case state::Unescaped: {
+					const size_t end = find(_position);
+					append(_data + _position, end - _position);
+					_position = end;
+					if (end == _size) {
+						break;
+					}
+
+					const char s = _data[end];
+					if (s == separator) {
+						_position++;
+						endField();
+						_state = state::FieldStart;
+					}
+					else if (s == '\"') {
+						// A quote in an unquoted field is kept as a literal character
+						flip(end);
+						_position++;
+						_state = state::UnescapedQuote;
+					}
+					else {
+						endField();
+						endLine(s);
+					}
+					break;
+				}
+
+				case state::UnescapedQuote:
+					// Either a doubled quote (keep one) or a stray quote (keep it)
+					append((_position > 0) ? _data + _position - 1 : &_quoteCharacter, 1);
+					if (c == '\"') {
+						flip(_position);
+						_position++;
+					}
+					_state = state::Unescaped;
+					break;
+
+				case state::Escaped: {
+					const size_t end = find(_position);
+					append(_data + _position, end - _position);
+					_position = end;
+					if (end == _size) {
+						break;
+					}
+
+					if (_data[end] == '\"') {
+						_state = state::EscapedQuote;
+					}
+					else {
+						append(_data + end, 1);
+					}
+					_position++;
+					break;
+				}
+
+				case state::EscapedQuote:
+					if (c == '\"') {
+						// 2DQUOTE
+						append((_position > 0) ? _data + _position - 1 : &_quoteCharacter, 1);
+						_position++;
+						_state = state::Escaped;
+					}
+					else {
+						_state = state::AfterEscaped;
+					}
+					break;
+
+				case state::AfterEscaped:
+				case state::Comment: {
+					// Skip everything up to the next separator (unless in a comment) or line end
+					const size_t end = find(_position);
+					_position = end;
+					if (end == _size) {
+						break;
+					}
+
+					const char s = _data[end];
+					if (s == '\r' || s == '\n') {
+						endField();
+						endLine(s);
+					}
+					else if (s == separator && _state == state::AfterEscaped) {
+						_position++;
+						endField();
+						_state = state::FieldStart;
+					}
+					else {
+						if (s == '\"') {
+							flip(end);
+						}
+						_position++;
+					}
+					break;
+				}
+
+				case state::AfterCR:
+					if (c == '\n') {
+						_position++;
+					}
+					_state = state::RecordStart;
+					break;
+			}
+
+			if (_ready) {
+				return true;
+			}
+		}
+
+		if (!_finished) {
+			detach();
+			return false;
+		}
+
+		// End of the input.  Complete whatever is in progress
+		switch (_state) {
+			case state::RecordStart:
+			case state::AfterCR:
+				return false;
+			case state::FieldStart:
+				// Separator as the very last character, which means an empty field right at the end
+				_trailing = true;
+				break;
+			case state::Whitespace:
+				// csv::parse keeps the final whitespace character of a field at the end of the input
+				append(&_spaceCharacter, 1);
+				break;
+			default:
+				break;
+		}
+
+		endField();
+		_state = state::RecordStart;
+		endRecord();
+		return true;
+	}
+};
+};
+
+// MARK: - Parse
+
+namespace {
+
+	csv::structural::dialect dialectFor(const csv::utf8::DataSource& source) {
+		csv::structural::dialect options;
+		options.separator = source.separator;
+		options.comment = source.comment;
+		options.trimLeadingWhitespace = source.trimLeadingWhitespace;
+		options.skipBlankLines = source.skipBlankLines;
+		return options;
+	}
+
+	/// Pull records from the source, calling 'emit' for each record (including blank lines).  'emit' returns
+	/// false to stop parsing.
+	template <typename Emit>
+	csv::State run(csv::utf8::DataSource& source, Emit emit) {
+		csv::structural::cursor records(source);
+		while (records.next()) {
+			if (!emit(records)) {
+				return csv::State::Complete;
+			}
+		}
+		return records.state();
+	}
+};
+
+namespace csv {
+namespace structural {
+
+	cursor::cursor(utf8::DataSource& source)
+	: _source(source), _tokens(dialectFor(source)) {
+		_source.cancelled = false;
+	}
+
+	cursor::cursor(utf8::DataSource& source, const csv::checkpoint& from)
+	: cursor(source) {
+		// Offset 0 is the start of the input, so leave the source to skip any BOM
+		if (from.offset > 0 && !_source.seek((size_t)from.offset)) {
+			_state = State::Error;
+			_done = true;
+			return;
+		}
+		_tokens.resume((size_t)from.row, from.carriageReturn);
+	}
+
+	cursor::~cursor() {
+		_source.parse_ended();
+	}
+
+	csv::checkpoint cursor::checkpoint() const {
+		// The source has been consumed up to the end of the current record (or to the end of the input)
+		csv::checkpoint result;
+		result.offset = _source.consumed();
+		result.row = _tokens.rows();
+
+		// Only a carriage return leaves the record unfinished.  If the following byte is at hand, settle it
+		result.carriageReturn = !_tokens.between_records('\n');
+		if (result.carriageReturn && _more && _consumed < _size) {
+			if (_data[_consumed] == '\n') {
+				result.offset++;
+			}
+			result.carriageReturn = false;
+		}
+		return result;
+	}
+
+	bool cursor::next() {
+		while (!_done) {
+			if (_tokens.next()) {
+				if (_source.cancelled.load(std::memory_order_relaxed)) {
+					_state = State::Cancelled;
+					_done = true;
+					return false;
+				}
+
+				// Keep the source position (and thus the progress) in step with the record
+				if (_more) {
+					_source.consume(_tokens.position() - _consumed);
+					_consumed = _tokens.position();
+				}
+				return true;
+			}
+
+			if (!_more) {
+				_done = true;
+				break;
+			}
+
+			// The current chunk is exhausted
+			_source.consume(_size - _consumed);
+			_consumed = 0;
+			_size = 0;
+
+			if (_source.fill(_data, _size)) {
+				_tokens.feed(_data, _size);
+			}
+			else {
+				_more = false;
+				_tokens.finish();
+				if (_source.failed()) {
+					// The records read so far are still delivered
+					_state = State::Error;
+				}
+			}
+		}
+		return false;
+	}
+};
+};
+
+namespace csv {
+namespace structural {
+
+	State parse(utf8::DataSource& source, FieldCallback emitField, RecordCallback emitRecord) {
+		const bool skipBlankLines = source.skipBlankLines;
+		csv::record record;
+
+		return run(source, [&](const cursor& tokens) -> bool {
+			const csv::record_view& view = tokens.record();
+
+			// Reuse the strings from the previous record where possible
+			record.row = view.row;
+			record.content.resize(view.size());
+
+			const size_t reported = view.size() - (tokens.trailing() ? 1 : 0);
+			for (size_t i = 0; i < view.size(); i++) {
+				csv::field& field = record.content[i];
+				field.row = view[i].row;
+				field.column = view[i].column;
+				field.content.assign(view[i].content.data(), view[i].content.size());
+
+				if (emitField && i < reported && emitField(field) == false) {
+					// Stop here, but still deliver the record as far as it got
+					record.content.resize(i + 1);
+					if (!skipBlankLines || !record.empty()) {
+						if (emitRecord) {
+							emitRecord(record, source.progress());
+						}
+					}
+					return false;
+				}
+			}
+
+			if (!skipBlankLines || !record.empty()) {
+				if (emitRecord && (emitRecord(record, source.progress()) == false)) {
+					return false;
+				}
+			}
+			return true;
+		});
+	}
+
+	State parse(utf8::DataSource& source, RecordViewCallback emitRecord) {
+		const bool skipBlankLines = source.skipBlankLines;
+
+		return run(source, [&](const cursor& tokens) -> bool {
+			const csv::record_view& view = tokens.record();
+			if (skipBlankLines && view.empty()) {
+				return true;
+			}
+			return !emitRecord || emitRecord(view, source.progress());
+		});
+	}
+
+	State parse(utf8::DataSource& source, const batch_limits& limits, RecordBatchCallback emitBatch) {
+		const bool skipBlankLines = source.skipBlankLines;
+		csv::record_batch batch;
+
+		const auto deliver = [&]() -> bool {
+			if (batch.empty()) {
+				return true;
+			}
+			batch.finish();
+			const bool more = !emitBatch || emitBatch(batch, source.progress());
+			batch.clear();
+			return more;
+		};
+
+		const State state = run(source, [&](const cursor& tokens) -> bool {
+			const csv::record_view& view = tokens.record();
+			if (skipBlankLines && view.empty()) {
+				return true;
+			}
+			batch.add(view);
+			return !batch.full(limits) || deliver();
+		});
+
+		deliver();
+		return state;
+	}
+};
+};
@@ -0,0 +1,256 @@
+//
+//  structural.hpp
+//
+//  MIT license
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+//  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all copies or substantial
+//  portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+//  WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+//  OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+//  OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#pragma once
+
+#include <csv/parser.hpp>
+#include <csv/checkpoint.hpp>
+#include <csv/datasource/utf8/DataSource.hpp>
+
+#include <stdint.h>
+
+// A two-stage parser for UTF-8 input.
+//
+// Stage one classifies 64 bytes at a time (AVX2 / SSE4.2 / scalar, selected at runtime) into bitmasks of
+// quotes, separators and line endings, and derives the quoted regions of the block using a prefix-XOR
+// of the quote bits.  Stage two walks the resulting structural positions, copying the text between them
+// in bulk rather than a character at a time.
+//
+// The results are identical to csv::parse, including its recovery from badly quoted fields.  Stage two
+// is authoritative -- whenever it sees a quote that does not open or close a quoted field (eg. 'fi"sh')
+// it corrects the quoted region mask for the remainder of the block.
+
+namespace csv {
+namespace structural {
+
+	/// Bitmasks for a block of 64 bytes.  Bit N refers to byte N of the block
+	struct block {
+		uint64_t quote = 0;
+		uint64_t separator = 0;
+		/// Carriage return or line feed
+		uint64_t eol = 0;
+	};
+
+	/// Stage one.  Classify the 64 bytes starting at 'data'
+	block classify(const char* data, char separator);
+
+	/// Bit N of the result is the XOR of bits 0...N of 'bits'.  Applied to the quote mask of a block, this
+	/// gives a mask of the bytes inside quotes.
+	uint64_t prefix_xor(uint64_t bits);
+
+	/// The parsing options
+	struct dialect {
+		char separator = ',';
+		char comment = '\0';
+		bool trimLeadingWhitespace = true;
+		bool skipBlankLines = true;
+	};
+
+	/// Stage two.  Splits UTF-8 input into records.
+	///
+	/// Input is supplied in chunks using feed(), and records are pulled using next().  All parser state is
+	/// held in the object, so records and fields can span chunks.  A chunk must remain valid until next()
+	/// returns false.
+	///
+	///     tokens.feed(data, size);
+	///     while (tokens.next()) { ... tokens.record() ... }
+	///     ...
+	///     tokens.finish();
+	///     while (tokens.next()) { ... tokens.record() ... }
+	class tokenizer {
+	public:
+		tokenizer(const dialect& options = dialect());
+
+		/// Start parsing a new chunk of input.  The previous chunk must have been exhausted.
+		void feed(const char* data, size_t size);
+
+		/// No more input.  Any partial record is completed by the next call to next()
+		void finish();
+
+		/// Move to the next complete record.  Returns false when more input is needed (or, after finish(),
+		/// when there are no more records)
+		bool next();
+
+		/// The most recently completed record.  Valid until the next call to next() or feed().
+		///
+		/// Fields refer directly to the input wherever possible.  Only fields that are not a single run of the
+		/// input (eg. containing a doubled quote) or that span two chunks are copied into a scratch buffer.
+		///
+		/// Rows are numbered as csv::parse does.  Blank lines are returned as a record with a single empty
+		/// field; skipping them (if dialect::skipBlankLines is set) is left to the caller.
+		inline const csv::record_view& record() const { return _view; }
+
+		/// True if the final field of the record is the implicit empty field following a separator at the
+		/// very end of the input (which csv::parse does not report to the field callback)
+		inline bool trailing() const { return _trailing; }
+
+		/// The number of bytes of the current chunk that have been parsed
+		inline size_t position() const { return _position; }
+
+		/// The number of rows returned so far (the row number of the next record)
+		inline size_t rows() const { return _row; }
+
+		/// True if the input so far ends exactly between two records.  'following' is the next byte of the input,
+		/// as a line feed directly after a carriage return still belongs to the previous record.
+		inline bool between_records(char following) const {
+			return _state == state::RecordStart || (_state == state::AfterCR && following != '\n');
+		}
+
+		/// Discard all state and start again
+		void reset();
+
+		/// Carry on from a checkpoint.  The next record is numbered 'row', and if 'carriageReturn' the input
+		/// before the next chunk ended with a carriage return, so a line feed starting it belongs to the
+		/// previous record
+		void resume(size_t row, bool carriageReturn);
+
+	private:
+		enum class state : uint8_t {
+			RecordStart,    // at the start of a record
+			FieldStart,     // after a separator
+			Whitespace,     // skipping leading whitespace
+			Unescaped,      // in an unquoted field
+			UnescapedQuote, // seen a quote within an unquoted field
+			Escaped,        // in a quoted field
+			EscapedQuote,   // seen a quote within a quoted field
+			AfterEscaped,   // seen the closing quote, skipping to the next separator or line end
+			Comment,        // skipping a comment line
+			AfterCR,        // seen a carriage return, swallow a following line feed
+		};
+
+		void startField(char c);
+		void endField();
+		void endLine(char c);
+		void endRecord();
+
+		void append(const char* data, size_t length);
+		void spill();
+		void detach();
+
+		size_t find(size_t from);
+		void load(size_t base, size_t from);
+		void flip(size_t position);
+
+		dialect _dialect;
+
+		const char* _data = nullptr;
+		size_t _size = 0;
+		size_t _position = 0;
+		bool _finished = false;
+
+		state _state = state::RecordStart;
+		bool _ready = false;
+		bool _trailing = false;
+		size_t _column = 0;
+		size_t _row = 0;
+
+		// The current field is either a single run of the input, or (once that isn't possible) a copy in
+		// _scratch starting at _fieldStart
+		const char* _run = nullptr;
+		size_t _runLength = 0;
+		bool _inScratch = false;
+		size_t _fieldStart = 0;
+
+		// The fields of the current record.  'data' is null for content held in _scratch
+		struct slot {
+			const char* data;
+			size_t offset;
+			size_t length;
+		};
+		std::vector<slot> _slots;
+		std::string _scratch;
+
+		std::vector<csv::field_view> _fields;
+		csv::record_view _view;
+
+		// Stage one results for the block currently being walked
+		size_t _block = (size_t)-1;
+		uint64_t _valid = 0;
+		uint64_t _quote = 0;
+		uint64_t _delimiter = 0;
+		uint64_t _inquote = 0;
+		uint64_t _structural = 0;
+	};
+
+	/// Pulls records from a UTF-8 data source through a tokenizer, reading from the source as needed.
+	///
+	/// All of the parse state is held in the object rather than on the stack, so parsing can be suspended
+	/// between any two records and resumed later -- eg. to interleave several sources on one thread.
+	///
+	///     csv::structural::cursor records(source);
+	///     while (records.next()) { ... records.record() ... }
+	class cursor {
+	public:
+		cursor(utf8::DataSource& source);
+
+		/// Carry on from a checkpoint taken while parsing the same input (see csv::checkpoint).  If the source
+		/// can't be seeked to it, next() returns false straight away and the state is State::Error
+		cursor(utf8::DataSource& source, const csv::checkpoint& from);
+
+		/// Tells the source that parsing has ended (see IDataSource::parse_ended())
+		~cursor();
+
+		cursor(const cursor&) = delete;
+		cursor& operator=(const cursor&) = delete;
+
+		/// Move to the next record (including blank lines).  Returns false once there are no more records,
+		/// or the source has been cancelled
+		bool next();
+
+		/// The current record.  Valid until the next call to next()
+		inline const csv::record_view& record() const { return _tokens.record(); }
+
+		/// See tokenizer::trailing()
+		inline bool trailing() const { return _tokens.trailing(); }
+
+		/// How parsing ended: State::Error if the source couldn't be read to its end (see
+		/// utf8::DataSource::failed()).  Only meaningful once next() has returned false
+		inline csv::State state() const { return _state; }
+
+		/// Where to carry on from to parse the records after the current one
+		csv::checkpoint checkpoint() const;
+
+	private:
+		utf8::DataSource& _source;
+		tokenizer _tokens;
+
+		const char* _data = nullptr;
+		size_t _size = 0;
+		size_t _consumed = 0;
+		bool _more = true;
+		bool _done = false;
+		csv::State _state = csv::State::Complete;
+	};
+
+	/// Parse a UTF-8 data source using the two-stage parser.  Produces the same results as csv::parse
+	csv::State parse(utf8::DataSource& source,
+					 csv::FieldCallback emitField,
+					 csv::RecordCallback emitRecord);
+
+	/// Parse a UTF-8 data source using the two-stage parser, without copying field content.  The record is
+	/// only valid for the duration of the callback.
+	csv::State parse(utf8::DataSource& source,
+					 csv::RecordViewCallback emitRecord);
+
+	/// Parse a UTF-8 data source using the two-stage parser, delivering records in batches
+	csv::State parse(utf8::DataSource& source,
+					 const csv::batch_limits& limits,
+					 csv::RecordBatchCallback emitBatch);
+};
+};
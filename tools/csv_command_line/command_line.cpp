@@ -29,7 +29,7 @@ bool handle_command_args(int argc, const char * const * argv, Arguments& args) {
 		cmd.add( verboseArg );
 		TCLAP::ValueArg<size_t> limitArg("l", "limit", "limit to the first <limit> records", false, 0, "limit");
 		cmd.add( limitArg );
-		TCLAP::UnlabeledValueArg<std::string> fileArg("file", "input file", true, "filenameString", "value");
+		TCLAP::UnlabeledValueArg<std::string> fileArg("file", "input file ('-' to read UTF-8 from stdin)", true, "filenameString", "value");
 		cmd.add( fileArg );
 		
 		// Parse the argv array.
@@ -1,8 +1,11 @@
 
 #include <iostream>
 #include <algorithm>
+#include <memory>
+#include <unistd.h>
 #include <csv/parser.hpp>
 #include <csv/datasource/icu/DataSource.hpp>
+#include <csv/datasource/utf8/DataSource.hpp>
 
 #include "command_line.hpp"
 
@@ -40,18 +43,34 @@ int main(int argc, const char * argv[]) {
 		return -1;
 	}
 
-	csv::icu::FileDataSource input;
-	if (!input.open(args.inputFile.c_str(), args.codepage.length() > 0 ? args.codepage.c_str() : NULL)) {
-		cerr << "Unable to open file" << endl;
-		exit(-1);
-	}
-
+	char separator = ',';
 	if (args.type == "tsv") {
-		input.separator = '\t';
+		separator = '\t';
 	}
 
 	if (args.separator != ',') {
-		input.separator = args.separator;
+		separator = args.separator;
+	}
+
+	std::unique_ptr<csv::IDataSource> input;
+	if (args.inputFile == "-") {
+		// Standard input (eg. a pipe), which must be UTF-8 as it can't be read twice to detect the encoding
+		auto source = std::make_unique<csv::utf8::FdDataSource>();
+		if (!source->open(STDIN_FILENO)) {
+			cerr << "Unable to read from stdin" << endl;
+			exit(-1);
+		}
+		source->separator = separator;
+		input = std::move(source);
+	}
+	else {
+		auto source = std::make_unique<csv::icu::FileDataSource>();
+		if (!source->open(args.inputFile.c_str(), args.codepage.length() > 0 ? args.codepage.c_str() : NULL)) {
+			cerr << "Unable to open file" << endl;
+			exit(-1);
+		}
+		source->separator = separator;
+		input = std::move(source);
 	}
 
 	int pp = -1;
@@ -95,7 +114,7 @@ int main(int argc, const char * argv[]) {
 
 		return true;
 	};
-	csv::parse(input, NULL, recordAdder);
+	csv::parse(*input, NULL, recordAdder);
 
 	if (args.verbose) {
 		PrintProgress(1, total);